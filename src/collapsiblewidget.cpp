@@ -252,6 +252,8 @@ void CollapsibleWidget::setExpanded(bool expanded)
                                       : QTimeLine::Backward );
   if (d->timeline->state() != QTimeLine::Running)
       d->timeline->start();
+
+  emit expandedChanged( expanded );
 }
 
 void CollapsibleWidget::animateCollapse( qreal showAmount )
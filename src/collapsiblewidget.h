@@ -79,6 +79,9 @@ class Q_GUI_EXPORT CollapsibleWidget : public QWidget
     void setExpanded(bool collapsed);
     void setCaption(const QString& caption);
 
+  signals:
+    void expandedChanged(bool expanded);
+
 
   protected:
     void init();
@@ -22,16 +22,21 @@
 #include "randrscreen.h"
 #include "randroutput.h"
 #include "outputgraphicsitem.h"
+#include "layoutsolver.h"
+#include "outputitemregistry.h"
 
 #include <QtGui/QGraphicsScene>
+#include <QtCore/QHash>
 #include <cmath>
 #include <math.h>
 
-LayoutManager::LayoutManager(RandRScreen *screen, QGraphicsScene *scene)
+LayoutManager::LayoutManager(RandRScreen *screen, QGraphicsScene *scene,
+                             const OutputItemRegistry *registry)
     : QObject(screen)
 {
     m_screen = screen;
     m_scene = scene;
+    m_registry = registry;
 }
 
 LayoutManager::~LayoutManager()
@@ -40,111 +45,119 @@ LayoutManager::~LayoutManager()
 
 void LayoutManager::slotAdjustOutput(OutputGraphicsItem *output)
 {
-    QPointF p = output->pos();
-    float nearest = m_scene->width() * m_scene->height();
-    OutputGraphicsItem *selected = NULL;
+    if (!output)
+        return;
 
-    OutputGraphicsItem *mouseGrabber = dynamic_cast<OutputGraphicsItem*>(m_scene->mouseGrabberItem());
-    // find the nearest item
-    QList<QGraphicsItem *> itemList = m_scene->items();
+    OutputGraphicsItem *mouseGrabber = m_registry->item(m_scene->mouseGrabberItem());
 
-    foreach(QGraphicsItem *current, itemList)
+    // index the edges of all other outputs
+    QList<OutputGraphicsItem*> candidates;
+    m_snapIndex.clear();
+    foreach(OutputGraphicsItem *cur, m_registry->items())
     {
-        OutputGraphicsItem *cur = dynamic_cast<OutputGraphicsItem*>(current);
-        if (cur == output || cur == mouseGrabber)
+        if (cur == output || cur == mouseGrabber || !cur->isVisible())
             continue;
 
-        QPointF pos = cur->pos();
-        float distance = (p.x() - pos.x())*(p.x()-pos.x()) + (p.y() - pos.y())*(p.y() - pos.y());
-        if (distance <=nearest)
-        {
-            nearest = distance;
-            selected  = cur;
-        }
+        m_snapIndex.insert(candidates.count(), cur->mapRectToScene(cur->rect()));
+        candidates.append(cur);
     }
+    m_snapIndex.build();
 
-    if (selected)
-    {
-        // find in which side this
-        QRectF s = selected->boundingRect();
-        QRectF i = output->boundingRect();
-
-        s.translate(selected->scenePos());
-        i.translate(output->scenePos());
-
-        // calculate the distances
-        float top = fabsf(i.top() - s.bottom());
-        float bottom = fabsf(i.bottom() - s.top());
-        float left = fabsf(i.left() - s.right());
-        float right = fabsf(i.right() - s.left());
+    OutputSnapIndex::Snap snap = m_snapIndex.nearest(output->mapRectToScene(output->rect()));
+    m_snapped.remove(output);
 
-        // choose top
-        if (top <= bottom && top <= left && top <= right)
-        {
-            output->setTop(selected);
-            selected->setBottom(output);
-        }
-        // choose bottom
-        else if (bottom < top && bottom <= left && bottom <= right)
-        {
-            output->setBottom(selected);
-            selected->setTop(output);
-        }
-        // choose left
-        else if (left < top && left < bottom && left <= right)
-        {
-            output->setLeft(selected);
-            selected->setRight(output);
-        }
-        // choose right
-        else
+    if (snap.id != -1)
+    {
+        OutputGraphicsItem *selected = candidates.at(snap.id);
+        switch (snap.side)
         {
-            output->setRight(selected);
-            selected->setLeft(output);
+            case OutputSnapIndex::SnapTop:
+                output->setTop(selected);
+                selected->setBottom(output);
+                break;
+            case OutputSnapIndex::SnapBottom:
+                output->setBottom(selected);
+                selected->setTop(output);
+                break;
+            case OutputSnapIndex::SnapLeft:
+                output->setLeft(selected);
+                selected->setRight(output);
+                break;
+            case OutputSnapIndex::SnapRight:
+                output->setRight(selected);
+                selected->setLeft(output);
+                break;
         }
-    }
 
-    // now visit all the outputs on the screen to adjust their positions
-    // starting by the item selected to be the parent of the current item
-    QList<OutputGraphicsItem *> visitedList;
+        Snapped snapped;
+        snapped.target = selected;
+        snapped.alignment = snap.alignment;
+        m_snapped.insert(output, snapped);
+    }
 
     // FIXME: after adjusting the scene, we have to translate everything back to
     // the 0,0 position so that everything is onscreen
-    output->setPos(0,0);
-    // call a recursive function to adjust the outputs
-    adjustScene(output, visitedList);
+    adjustScene(output);
 }
 
-void LayoutManager::adjustScene(OutputGraphicsItem *current, QList<OutputGraphicsItem*> &visited)
+LayoutSolver::Alignment LayoutManager::alignment(OutputGraphicsItem *a, OutputGraphicsItem *b) const
 {
-    visited.append(current);
+    if (m_snapped.contains(a) && m_snapped.value(a).target == b)
+        return m_snapped.value(a).alignment;
+    if (m_snapped.contains(b) && m_snapped.value(b).target == a)
+        return m_snapped.value(b).alignment;
+    return LayoutSolver::AlignStart;
+}
+
+void LayoutManager::adjustScene(OutputGraphicsItem *anchor)
+{
+    // turn the links between the items into constraints and solve them all
+    // at once, starting from the item that was just placed
+    LayoutSolver solver;
+    QHash<OutputGraphicsItem*, uint> ids;
+    QList<OutputGraphicsItem*> items;
 
-    OutputGraphicsItem *item;
-    item = current->left();
-    if (item && visited.indexOf(item) == -1)
+    foreach(OutputGraphicsItem *item, m_registry->items())
     {
-        item->setPos(current->x() - item->boundingRect().width(), current->y());
-        adjustScene(item, visited);
+        uint id = items.count();
+        ids.insert(item, id);
+        items.append(item);
+        solver.addNode(id, item->boundingRect().size().toSize());
     }
 
-    item = current->right();
-    if (item && visited.indexOf(item) == -1)
+    // forget the alignments of items that are gone from the scene
+    foreach(OutputGraphicsItem *item, m_snapped.keys())
     {
-        item->setPos(current->x() + current->boundingRect().width(), current->y());
-        adjustScene(item, visited);
+        if (!ids.contains(item) || !ids.contains(m_snapped.value(item).target))
+            m_snapped.remove(item);
     }
 
-    item = current->top();
-    if (item && visited.indexOf(item) == -1)
+    foreach(OutputGraphicsItem *item, items)
     {
-        item->setPos(current->x(), current->y() - item->boundingRect().height());
-        adjustScene(item, visited);
+        uint id = ids.value(item);
+        if (item->left() && ids.contains(item->left()))
+            solver.addConstraint(ids.value(item->left()), LayoutSolver::LeftOf, id,
+                                 alignment(item, item->left()));
+        if (item->top() && ids.contains(item->top()))
+            solver.addConstraint(ids.value(item->top()), LayoutSolver::Above, id,
+                                 alignment(item, item->top()));
+        if (item->right() && ids.contains(item->right()))
+            solver.addConstraint(ids.value(item->right()), LayoutSolver::RightOf, id,
+                                 alignment(item, item->right()));
+        if (item->bottom() && ids.contains(item->bottom()))
+            solver.addConstraint(ids.value(item->bottom()), LayoutSolver::Below, id,
+                                 alignment(item, item->bottom()));
     }
 
-    item = current->bottom();
-    if (item && visited.indexOf(item) == -1)
+    uint anchorId = ids.value(anchor);
+    solver.setAnchor(anchorId, QPoint(0, 0));
+    solver.solve();
+
+    // items that are not linked to the anchor stay where they are
+    foreach(OutputGraphicsItem *item, items)
     {
-        item->setPos(current->x(), current->y() + current->boundingRect().height());
-        adjustScene(item, visited);
+        uint id = ids.value(item);
+        if (solver.component(id) == solver.component(anchorId))
+            item->setPos(solver.rect(id).topLeft());
     }
 }
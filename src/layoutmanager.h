@@ -21,28 +21,43 @@
 #define __LAYOUTMANAGER_H__
 
 #include <QtCore/QObject>
+#include <QtCore/QHash>
 #include "randr.h"
+#include "layoutsolver.h"
+#include "outputsnapindex.h"
 
 class RandRScreen;
 class QGraphicsScene;
 class OutputGraphicsItem;
+class OutputItemRegistry;
 
 class LayoutManager : public QObject
 {
    Q_OBJECT
 public:
-    LayoutManager(RandRScreen *screen, QGraphicsScene *scene);
+    LayoutManager(RandRScreen *screen, QGraphicsScene *scene, const OutputItemRegistry *registry);
     ~LayoutManager();
 
 public slots:
     void slotAdjustOutput(OutputGraphicsItem *output);
 
 protected:
-    void adjustScene(OutputGraphicsItem *current, QList<OutputGraphicsItem*> &visited);
+    void adjustScene(OutputGraphicsItem *anchor);
 
 private:
+    struct Snapped
+    {
+        OutputGraphicsItem *target;
+        LayoutSolver::Alignment alignment;
+    };
+
+    LayoutSolver::Alignment alignment(OutputGraphicsItem *a, OutputGraphicsItem *b) const;
+
     RandRScreen *m_screen;
     QGraphicsScene *m_scene;
+    const OutputItemRegistry *m_registry;
+    OutputSnapIndex m_snapIndex;
+    QHash<OutputGraphicsItem*, Snapped> m_snapped;
 };
 
 #endif
@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDebug>
+#include <QtCore/QQueue>
+
+#include "layoutsolver.h"
+
+LayoutSolver::LayoutSolver()
+    : m_conflicts(0)
+{
+}
+
+void LayoutSolver::addNode(uint id, const QSize &size)
+{
+    if (m_index.contains(id))
+    {
+        m_nodes[m_index.value(id)].size = size;
+        return;
+    }
+
+    Node node;
+    node.id = id;
+    node.size = size;
+    node.anchored = false;
+    node.solved = false;
+    node.component = -1;
+    m_index.insert(id, m_nodes.count());
+    m_nodes.append(node);
+}
+
+void LayoutSolver::setAnchor(uint id, const QPoint &pos)
+{
+    if (!m_index.contains(id))
+        return;
+
+    Node &node = m_nodes[m_index.value(id)];
+    node.pos = pos;
+    node.anchored = true;
+}
+
+bool LayoutSolver::addConstraint(uint node, Relation relation, uint reference, Alignment alignment)
+{
+    if (node == reference || !m_index.contains(node) || !m_index.contains(reference))
+        return false;
+
+    Constraint c;
+    c.node = node;
+    c.relation = relation;
+    c.reference = reference;
+    c.alignment = alignment;
+    m_constraints.append(c);
+    return true;
+}
+
+QPoint LayoutSolver::offset(const Node &node, Relation relation, const Node &reference,
+                            Alignment alignment) const
+{
+    // alignment along the shared edge
+    int dx = 0, dy = 0;
+    switch (alignment) {
+        case AlignStart:
+            break;
+        case AlignCenter:
+            dx = (reference.size.width() - node.size.width()) / 2;
+            dy = (reference.size.height() - node.size.height()) / 2;
+            break;
+        case AlignEnd:
+            dx = reference.size.width() - node.size.width();
+            dy = reference.size.height() - node.size.height();
+            break;
+    }
+
+    switch (relation) {
+        case LeftOf:
+            return QPoint(-node.size.width(), dy);
+        case RightOf:
+            return QPoint(reference.size.width(), dy);
+        case Above:
+            return QPoint(dx, -node.size.height());
+        case Below:
+            return QPoint(dx, reference.size.height());
+        case SameAs:
+            return (alignment == AlignStart) ? QPoint(0, 0) : QPoint(dx, dy);
+    }
+
+    return QPoint(0, 0);
+}
+
+bool LayoutSolver::solve()
+{
+    m_conflicts = 0;
+    m_reported.fill(false, m_constraints.count());
+
+    // build the graph, each constraint is stored on both of its ends
+    for (int i = 0; i < m_nodes.count(); ++i)
+    {
+        m_nodes[i].edges.clear();
+        m_nodes[i].solved = false;
+        m_nodes[i].component = -1;
+    }
+
+    for (int i = 0; i < m_constraints.count(); ++i)
+    {
+        const Constraint &c = m_constraints.at(i);
+        int n = m_index.value(c.node);
+        int r = m_index.value(c.reference);
+        QPoint d = offset(m_nodes.at(n), c.relation, m_nodes.at(r), c.alignment);
+
+        Edge forward;
+        forward.to = n;
+        forward.offset = d;
+        forward.constraint = i;
+        m_nodes[r].edges.append(forward);
+
+        Edge backward;
+        backward.to = r;
+        backward.offset = -d;
+        backward.constraint = i;
+        m_nodes[n].edges.append(backward);
+    }
+
+    // anchored nodes first, then whatever components are left
+    int component = 0;
+    for (int i = 0; i < m_nodes.count(); ++i)
+    {
+        if (m_nodes.at(i).anchored && !m_nodes.at(i).solved)
+            propagate(i, component++);
+    }
+    for (int i = 0; i < m_nodes.count(); ++i)
+    {
+        if (!m_nodes.at(i).solved)
+        {
+            m_nodes[i].pos = QPoint(0, 0);
+            propagate(i, component++);
+        }
+    }
+
+    return m_conflicts == 0;
+}
+
+void LayoutSolver::propagate(int start, int component)
+{
+    QQueue<int> queue;
+    QVector<bool> &reported = m_reported;
+
+    m_nodes[start].solved = true;
+    m_nodes[start].component = component;
+    queue.enqueue(start);
+
+    while (!queue.isEmpty())
+    {
+        int current = queue.dequeue();
+        QPoint pos = m_nodes.at(current).pos;
+
+        foreach(const Edge &edge, m_nodes.at(current).edges)
+        {
+            Node &next = m_nodes[edge.to];
+            QPoint expected = pos + edge.offset;
+
+            if (!next.solved)
+            {
+                // anchored nodes keep their position, the edge then conflicts
+                if (next.anchored && next.pos != expected)
+                {
+                    reported[edge.constraint] = true;
+                    m_conflicts++;
+                }
+                else
+                    next.pos = expected;
+                next.solved = true;
+                next.component = component;
+                queue.enqueue(edge.to);
+            }
+            else if (next.pos != expected && !reported.at(edge.constraint))
+            {
+                // a cycle that does not close
+                reported[edge.constraint] = true;
+                m_conflicts++;
+            }
+        }
+    }
+
+    if (m_conflicts > 0)
+        qDebug() << "Layout has" << m_conflicts << "conflicting constraints";
+}
+
+void LayoutSolver::normalize()
+{
+    if (m_nodes.isEmpty())
+        return;
+
+    QPoint min = m_nodes.first().pos;
+    foreach(const Node &node, m_nodes)
+    {
+        min.setX(qMin(min.x(), node.pos.x()));
+        min.setY(qMin(min.y(), node.pos.y()));
+    }
+
+    for (int i = 0; i < m_nodes.count(); ++i)
+        m_nodes[i].pos -= min;
+}
+
+QRect LayoutSolver::rect(uint id) const
+{
+    if (!m_index.contains(id))
+        return QRect();
+
+    const Node &node = m_nodes.at(m_index.value(id));
+    return QRect(node.pos, node.size);
+}
+
+int LayoutSolver::component(uint id) const
+{
+    if (!m_index.contains(id))
+        return -1;
+
+    return m_nodes.at(m_index.value(id)).component;
+}
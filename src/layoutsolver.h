@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef LAYOUTSOLVER_H
+#define LAYOUTSOLVER_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QRect>
+#include <QtCore/QVector>
+
+/** Computes output positions from adjacency constraints.
+ *
+ * Every output is a node with a size, every "left of", "above" or "same as"
+ * relation is an edge. Positions are propagated along the edges in a single
+ * breadth first pass, so the cost is linear in the number of outputs and
+ * relations. Edges that contradict positions already derived from other
+ * edges are reported as conflicts instead of being applied. The solver only
+ * works on rectangles, so it can be used without any widget or scene. */
+class LayoutSolver
+{
+public:
+    enum Relation {
+        LeftOf,
+        RightOf,
+        Above,
+        Below,
+        SameAs
+    };
+
+    /** How an output lines up with the output it is related to, along the
+     * edge they share. */
+    enum Alignment {
+        AlignStart,
+        AlignCenter,
+        AlignEnd
+    };
+
+    LayoutSolver();
+
+    void addNode(uint id, const QSize &size);
+
+    /** Fixes the position of a node. Nodes not connected to any anchored
+     * node are laid out from (0,0). */
+    void setAnchor(uint id, const QPoint &pos);
+
+    /** @p node is @p relation to @p reference, e.g. node LeftOf reference. */
+    bool addConstraint(uint node, Relation relation, uint reference,
+                       Alignment alignment = AlignStart);
+
+    /** Solves all positions. Returns false if some constraints conflict;
+     * those are skipped. */
+    bool solve();
+
+    /** Moves the solved layout so that it starts at (0,0). */
+    void normalize();
+
+    QRect rect(uint id) const;
+
+    /** Nodes linked by constraints share the same component number. */
+    int component(uint id) const;
+
+private:
+    struct Constraint
+    {
+        uint node;
+        Relation relation;
+        uint reference;
+        Alignment alignment;
+    };
+
+    struct Edge
+    {
+        int to;
+        QPoint offset; // position of 'to' relative to this node
+        int constraint;
+    };
+
+    struct Node
+    {
+        uint id;
+        QSize size;
+        QPoint pos;
+        bool anchored;
+        bool solved;
+        int component;
+        QList<Edge> edges;
+    };
+
+    QPoint offset(const Node &node, Relation relation, const Node &reference,
+                  Alignment alignment) const;
+    void propagate(int start, int component);
+
+    QVector<Node> m_nodes;
+    QHash<uint,int> m_index;
+    QList<Constraint> m_constraints;
+    int m_conflicts;
+    QVector<bool> m_reported;
+};
+
+#endif // LAYOUTSOLVER_H
@@ -19,22 +19,36 @@
 #include <QtGui/QApplication>
 #include <QtCore/QSettings>
 #include <QtCore/QFile>
+#include <QtCore/QStringList>
 #include <QtCore/QDebug>
+#include <QtCore/QElapsedTimer>
 #include <getopt.h>
 #include <stdlib.h>
 
 #include "razorrandrconfiguration.h"
 #include "loaderconfiglogin.h"
+#include "randrdisplay.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+#include "videowalllayout.h"
+#include "randrscalingplan.h"
+#include "randrconfigstore.h"
+#include "randrbenchmark.h"
 
 #define out
 
-const char* const short_options = "vhs";
+const char* const short_options = "vhsw:b:o:d::";
 
 const struct option long_options[] = {
-    {"version", 0, NULL, 'v'},
-    {"help",    0, NULL, 'h'},
-    {"startup", 0, NULL, 's'},
-    {NULL,      0, NULL,  0}
+    {"version",    0, NULL, 'v'},
+    {"help",       0, NULL, 'h'},
+    {"startup",    0, NULL, 's'},
+    {"video-wall", 1, NULL, 'w'},
+    {"bezel",      1, NULL, 'b'},
+    {"wall-order", 1, NULL, 'o'},
+    {"hidpi",      2, NULL, 'd'},
+    {"benchmark",  0, NULL, 'B'},
+    {NULL,         0, NULL,  0}
 };
 
 void print_usage_and_exit(int code)
@@ -42,6 +56,14 @@ void print_usage_and_exit(int code)
     printf("LXQt Randr Configuration %s\n", STR_VERSION);
     puts("Usage: lxqt-config-randr [OPTION]...\n");
     puts("  -s,  --startup            Apply configuration from the saved settings");
+    puts("  -w,  --video-wall RxC     Arrange the panels as a grid of R rows and C columns");
+    puts("  -b,  --bezel H[,V]        Bezel width of one panel edge in mm, for the video wall");
+    puts("  -o,  --wall-order A,B,... Outputs of the video wall in row-major order");
+    puts("                            the other outputs are disabled");
+    puts("  -d,  --hidpi[=DPI]        Scale outputs of different densities to the same size,");
+    puts("                            DPI is the density of scale 1 (default 96)");
+    puts("       --benchmark          Show the dialog, print how long each phase took until");
+    puts("                            its first paint and exit");
     puts("  -h,  --help               Print this help");
     puts("  -v,  --version            Prints application version and exits");
     puts("\nHomepage: <https://github.com/zballina/lxqt-config-randr>");
@@ -55,10 +77,14 @@ void print_version_and_exit(int code=0)
     exit(code);
 }
 
-void parse_args(int argc, char* argv[], out bool& startup)
+void parse_args(int argc, char* argv[], out bool& startup,
+                out QString& wall, out QString& bezel, out QString& order,
+                out bool& hidpi, out QString& dpi, out bool& benchmark)
 {
     int next_option;
     startup = false;
+    hidpi = false;
+    benchmark = false;
     do{
         next_option = getopt_long(argc, argv, short_options, long_options, NULL);
         switch(next_option)
@@ -68,6 +94,23 @@ void parse_args(int argc, char* argv[], out bool& startup)
             case 's':
                 startup = true;
                 break;
+            case 'w':
+                wall = QString::fromLocal8Bit(optarg);
+                break;
+            case 'b':
+                bezel = QString::fromLocal8Bit(optarg);
+                break;
+            case 'o':
+                order = QString::fromLocal8Bit(optarg);
+                break;
+            case 'd':
+                hidpi = true;
+                if (optarg)
+                    dpi = QString::fromLocal8Bit(optarg);
+                break;
+            case 'B':
+                benchmark = true;
+                break;
             case '?':
                 print_usage_and_exit(1);
             case 'v':
@@ -77,8 +120,131 @@ void parse_args(int argc, char* argv[], out bool& startup)
     while(next_option != -1);
 }
 
+void print_layout_errors(RandRScreen *screen)
+{
+    foreach(const RandRLayoutError &error, screen->layoutErrors())
+        fprintf(stderr, "%s\n", qPrintable(error.message()));
+}
+
+int apply_video_wall(const QString& wall, const QString& bezel, const QString& order)
+{
+    QStringList grid = wall.split('x');
+    bool rowsOk = false, columnsOk = false;
+    int rows = grid.value(0).toInt(&rowsOk);
+    int columns = grid.value(1).toInt(&columnsOk);
+    if (grid.count() != 2 || !rowsOk || !columnsOk)
+    {
+        fprintf(stderr, "Invalid video wall grid: %s\n", qPrintable(wall));
+        return 1;
+    }
+
+    RandRDisplay display;
+    if (!display.isValid())
+        return 1;
+
+    RandRScreen *screen = display.currentScreen();
+    VideoWallLayout layout(screen);
+    layout.setGrid(rows, columns);
+
+    if (!bezel.isEmpty())
+    {
+        QStringList widths = bezel.split(',');
+        bool horizontalOk = false, verticalOk = true;
+        qreal horizontal = widths.value(0).toDouble(&horizontalOk);
+        qreal vertical = widths.count() > 1 ? widths.value(1).toDouble(&verticalOk) : horizontal;
+        if (widths.count() > 2 || !horizontalOk || !verticalOk || horizontal < 0 || vertical < 0)
+        {
+            fprintf(stderr, "Invalid bezel width: %s\n", qPrintable(bezel));
+            return 1;
+        }
+        layout.setBezel(horizontal, vertical);
+    }
+
+    if (!order.isEmpty())
+    {
+        QList<RandROutput*> panels;
+        foreach(const QString &name, order.split(','))
+        {
+            RandROutput *panel = 0;
+            foreach(RandROutput *output, screen->outputs())
+            {
+                if (output->name() == name)
+                    panel = output;
+            }
+            if (!panel)
+            {
+                fprintf(stderr, "Unknown output: %s\n", qPrintable(name));
+                return 1;
+            }
+            if (panels.contains(panel))
+            {
+                fprintf(stderr, "Output given more than once: %s\n", qPrintable(name));
+                return 1;
+            }
+            panels.append(panel);
+        }
+        layout.setOrder(panels);
+    }
+
+    if (!layout.compute())
+    {
+        fprintf(stderr, "%s\n", qPrintable(layout.errorString()));
+        return 1;
+    }
+
+    // the whole wall goes to the server as one layout
+    layout.propose();
+    if (!screen->applyProposed(false))
+    {
+        print_layout_errors(screen);
+        return 1;
+    }
+
+    screen->save();
+    return screen->flushSettings() ? 0 : 1;
+}
+
+int apply_hidpi(const QString& dpi)
+{
+    RandRDisplay display;
+    if (!display.isValid())
+        return 1;
+
+    RandRScreen *screen = display.currentScreen();
+    RandRScalingPlan plan(screen);
+    if (!dpi.isEmpty())
+    {
+        bool ok = false;
+        qreal reference = dpi.toDouble(&ok);
+        if (!ok || reference <= 0)
+        {
+            fprintf(stderr, "Invalid DPI: %s\n", qPrintable(dpi));
+            return 1;
+        }
+        plan.setReferenceDpi(reference);
+    }
+
+    if (!plan.compute())
+        return 1;
+
+    // sizes, transforms and the reported DPI go to the server as one layout
+    plan.propose();
+    if (!screen->applyProposed(false))
+    {
+        print_layout_errors(screen);
+        return 1;
+    }
+
+    screen->save();
+    return screen->flushSettings() ? 0 : 1;
+}
+
 int main(int argc, char *argv[])
 {
+    // the benchmark counts from here, before the connection to the server
+    QElapsedTimer clock;
+    clock.start();
+
     Q_INIT_RESOURCE(lxqtconfigrandr);
 
     QApplication::setApplicationName("lxqt-config-randr");
@@ -87,17 +253,31 @@ int main(int argc, char *argv[])
 #endif
     QApplication::setOrganizationDomain("lxqt");
     QSettings::setDefaultFormat(QSettings::NativeFormat);
+    // RandRWorker talks to the server from a thread of its own
+    QApplication::setAttribute(Qt::AA_X11InitThreads);
 
     QApplication a(argc, argv);
 
     bool startup;
-    parse_args(argc, argv, startup);
+    bool hidpi;
+    bool benchmark;
+    QString wall, bezel, order, dpi;
+    parse_args(argc, argv, startup, wall, bezel, order, hidpi, dpi, benchmark);
+
+    if(benchmark)
+        RandRBenchmark::start(clock);
+
+    if(!wall.isEmpty())
+        exit(apply_video_wall(wall, bezel, order));
+
+    if(hidpi)
+        exit(apply_hidpi(dpi));
 
     if(startup)
     {
         QSettings config;
         QFile fileconfig(config.fileName());
-        if(fileconfig.exists())
+        if(QFile::exists(RandRConfigStore::defaultFileName()) || fileconfig.exists())
         {
             LoaderConfigLogin loader;
             loader.execute();
@@ -110,10 +290,11 @@ int main(int argc, char *argv[])
 
         exit(0);
     }
-    else
-    {
-        LXQtRandrConfig *w = new LXQtRandrConfig;
-        w->show();
-    }
+
+    // owned here, so that pending brightness is set and the worker is
+    // stopped when the dialog goes away after the event loop
+    LXQtRandrConfig w;
+    RandRBenchmark::watch(&w);
+    w.show();
     return a.exec();
 }
@@ -20,38 +20,73 @@
 
 #include "outputconfig.h"
 #include "outputgraphicsitem.h"
+#include "outputpositionresolver.h"
 #include "randroutput.h"
 #include "randrscreen.h"
 #include "randrmode.h"
 #include "randrcrtc.h"
+#include "randrbenchmark.h"
 #include <QtCore/QDebug>
 #include <QMessageBox>
+#include <QtGui/QStandardItemModel>
 
-OutputConfig::OutputConfig(QWidget* parent, RandROutput* output, OutputConfigList preceding, bool unified)
+static void appendItem(QStandardItemModel *model, const QString &text, const QVariant &data,
+                       const QIcon &icon = QIcon())
+{
+    QStandardItem *item = new QStandardItem(icon, text);
+    item->setData(data, Qt::UserRole);
+    model->appendRow(item);
+}
+
+/* Puts a prebuilt model into a combo in one step. The combo stays silent
+ * until endRebuild() instead of signalling every item it loses or gains,
+ * which would run the whole chain of update slots each time; the caller
+ * selects an item meanwhile and then acts once on the outcome. */
+static QString beginRebuild(QComboBox *combo, QStandardItemModel *model)
+{
+    QString previous = combo->currentText();
+    combo->blockSignals(true);
+    // the old model is owned by the combo and deleted with the swap
+    combo->setModel(model);
+    return previous;
+}
+
+/* Returns whether the selected item changed. */
+static bool endRebuild(QComboBox *combo, const QString &previous)
+{
+    combo->blockSignals(false);
+    return combo->currentText() != previous;
+}
+
+OutputConfig::OutputConfig(QWidget* parent, RandROutput* output, OutputConfigList preceding, bool unified,
+                           OutputPositionResolver *resolver)
     : QWidget(parent)
     , precedingOutputConfigs( preceding )
 {
     m_output = output;
     m_unified = unified;
+    m_resolver = resolver;
     Q_ASSERT(output);
+    Q_ASSERT(resolver);
 
     setupUi(this);
+    linkUnifiedCombos();
+
+    // anything a position depends on invalidates the resolved positions
+    connect(positionCombo, SIGNAL(currentIndexChanged(int)), m_resolver, SLOT(invalidate()));
+    connect(positionOutputCombo, SIGNAL(currentIndexChanged(int)), m_resolver, SLOT(invalidate()));
+    connect(absolutePosX, SIGNAL(valueChanged(int)), m_resolver, SLOT(invalidate()));
+    connect(absolutePosY, SIGNAL(valueChanged(int)), m_resolver, SLOT(invalidate()));
 
     // connect signals
     connect(positionCombo, SIGNAL(currentIndexChanged(int)),
             this, SLOT(positionComboChanged(int)));
     connect(sizeCombo, SIGNAL(currentIndexChanged(int)),
-            this, SLOT(updateRateList(int)));
-    connect(sizeCombo, SIGNAL(currentIndexChanged(int)),
-            this, SLOT(updatePositionList()));
-    connect(sizeCombo, SIGNAL(currentIndexChanged(int)),
-            this, SLOT(updateRotationList()));
+            this, SLOT(sizeChanged(int)));
     connect(m_output, SIGNAL(outputChanged(RROutput,int)),
             this,     SLOT(outputChanged(RROutput,int)));
     connect(scaleComboBox, SIGNAL(currentIndexChanged(int)),
             this, SLOT(virtualModeScaleComboChanged(int)));
-    connect(sizeCombo, SIGNAL(currentIndexChanged(int)),
-            this, SLOT(updateVirtualModeResolution()));
     connect(vitualModecheckBox, SIGNAL(stateChanged(int)), this, SLOT(enableVirtualMode(int)));
 
     enableVirtualMode(vitualModecheckBox->checkState());
@@ -66,18 +101,17 @@ OutputConfig::OutputConfig(QWidget* parent, RandROutput* output, OutputConfigLis
     connect(absolutePosX, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
     connect(absolutePosY, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
     connect(brightnessSlider, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
+    connect(brightnessSlider, SIGNAL(valueChanged(int)), this, SLOT(previewBrightness(int)));
     //connect(scaleComboBox, SIGNAL(currentIndexChanged(int)), this, SLOT(setConfigDirty()));
     connect(trackingCheckBox, SIGNAL(stateChanged(int)), this, SLOT(setConfigDirty()));
     connect(virtualYModeSpinBox, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
     connect(virtualXModeSpinBox, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
 
-    connect(sizeCombo,    SIGNAL(currentIndexChanged(int)), this, SIGNAL(updateView()));
     connect(orientationCombo, SIGNAL(currentIndexChanged(int)), this, SIGNAL(updateView()));
     connect(positionCombo,    SIGNAL(currentIndexChanged(int)), this, SIGNAL(updateView()));
     connect(positionOutputCombo, SIGNAL(currentIndexChanged(int)), this, SIGNAL(updateView()));
     connect(absolutePosX, SIGNAL(valueChanged(int)), this, SIGNAL(updateView()));
     connect(absolutePosY, SIGNAL(valueChanged(int)), this, SIGNAL(updateView()));
-    connect(brightnessSlider,    SIGNAL(valueChanged(int)), this, SIGNAL(updateView()));
     //connect(scaleComboBox, SIGNAL(currentIndexChanged(int)), this, SIGNAL(updateView()));
     connect(trackingCheckBox, SIGNAL(stateChanged(int)), this, SIGNAL(updateView()));
     connect(virtualYModeSpinBox, SIGNAL(valueChanged(int)), this, SIGNAL(updateView()));
@@ -103,36 +137,22 @@ RandROutput *OutputConfig::output(void) const
 
 QPoint OutputConfig::position(void) const
 {
-    if( !isActive())
-        return QPoint();
-    int index = positionCombo->currentIndex();
-    if((Relation)positionCombo->itemData(index).toInt() == Absolute)
-        return QPoint(absolutePosX->value(), absolutePosY->value());
+    return m_resolver->position(this);
+}
 
-    foreach(OutputConfig *config, precedingOutputConfigs)
-    {
-        if( config->output()->id()
-            == positionOutputCombo->itemData( positionOutputCombo->currentIndex()).toUInt())
-        {
-            QPoint pos = config->position();
-            switch( (Relation)positionCombo->itemData(index).toInt())
-            {
-                case LeftOf:
-                    return QPoint( pos.x() - resolution().width(), pos.y());
-                case RightOf:
-                    return QPoint( pos.x() + config->resolution().width(), pos.y());
-                case Over:
-                    return QPoint( pos.x(), pos.y() - resolution().height());
-                case Under:
-                    return QPoint( pos.x(), pos.y() + config->resolution().height());
-                case SameAs:
-                    return pos;
-                default:
-                    abort();
-            }
-        }
-    }
-    return QPoint(0, 0);
+OutputConfig::Relation OutputConfig::relation(void) const
+{
+    return (Relation)positionCombo->itemData(positionCombo->currentIndex()).toInt();
+}
+
+RROutput OutputConfig::relativeTo(void) const
+{
+    return positionOutputCombo->itemData(positionOutputCombo->currentIndex()).toUInt();
+}
+
+QPoint OutputConfig::absolutePosition(void) const
+{
+    return QPoint(absolutePosX->value(), absolutePosY->value());
 }
 
 QSize OutputConfig::resolution(void) const
@@ -236,6 +256,43 @@ bool OutputConfig::hasPendingChanges( const QPoint& normalizePos ) const
 void OutputConfig::setUnifyOutput(bool unified)
 {
     m_unified = unified;
+    linkUnifiedCombos();
+    updatePositionListTimer.start( 0 );
+}
+
+void OutputConfig::linkUnifiedCombos()
+{
+    // unified outputs follow the size and orientation picked on any of them
+    foreach(OutputConfig *config, precedingOutputConfigs)
+    {
+        disconnect(config->sizeCombo, SIGNAL(activated(int)), sizeCombo, SLOT(setCurrentIndex(int)));
+        disconnect(sizeCombo, SIGNAL(activated(int)), config->sizeCombo, SLOT(setCurrentIndex(int)));
+        disconnect(config->orientationCombo, SIGNAL(activated(int)), orientationCombo, SLOT(setCurrentIndex(int)));
+        disconnect(orientationCombo, SIGNAL(activated(int)), config->orientationCombo, SLOT(setCurrentIndex(int)));
+        if (!m_unified)
+            continue;
+
+        connect(config->sizeCombo, SIGNAL(activated(int)), sizeCombo, SLOT(setCurrentIndex(int)));
+        connect(sizeCombo, SIGNAL(activated(int)), config->sizeCombo, SLOT(setCurrentIndex(int)));
+        connect(config->orientationCombo, SIGNAL(activated(int)), orientationCombo, SLOT(setCurrentIndex(int)));
+        connect(orientationCombo, SIGNAL(activated(int)), config->orientationCombo, SLOT(setCurrentIndex(int)));
+    }
+}
+
+void OutputConfig::sizeChanged(int index)
+{
+    m_resolver->invalidate();
+    updateRateList(index);
+    updatePositionList();
+    updateRotationList();
+    updateVirtualModeResolution();
+    emit updateView();
+}
+
+void OutputConfig::removePreceding(OutputConfig *config)
+{
+    precedingOutputConfigs.removeAll(config);
+    QObject::disconnect(config, 0, this, 0);
     updatePositionListTimer.start( 0 );
 }
 
@@ -323,13 +380,15 @@ QString OutputConfig::positionName(Relation position)
 
 void OutputConfig::load()
 {
+    RandRBenchmark::Phase phase("OutputConfig::load");
     qDebug() << "Loading output configuration for" << m_output->name();
     setEnabled( m_output->isConnected() );
 
-    orientationCombo->clear();
-
     if (!m_output->isConnected())
+    {
+        orientationCombo->clear();
         return;
+    }
 
     /* Mode size configuration */
     updateSizeList();
@@ -399,9 +458,8 @@ void OutputConfig::updateVirtualModeResolution(void)
 void OutputConfig::enableVirtualMode(int state)
 {
     bool enable = (state == Qt::Checked);
-     int major, minor;
-    XRRQueryVersion (QX11Info::display(), &major, &minor);
-    if (major > 1 || (major == 1 && minor >= 3))
+    const RandRCapabilities &capabilities = m_output->screen()->capabilities();
+    if (capabilities.transform && capabilities.panning)
     {
         //virtualXModeSpinBox->setEnabled(enable);
         //virtualYModeSpinBox->setEnabled(enable);
@@ -466,11 +524,6 @@ void OutputConfig::updatePositionListDelayed()
     absolutePosX->setVisible(true);
     absolutePosY->setVisible(true);
 
-    disconnect(positionCombo,    SIGNAL(currentIndexChanged(int)), this, SLOT(setConfigDirty()));
-    disconnect(positionOutputCombo,    SIGNAL(currentIndexChanged(int)), this, SLOT(setConfigDirty()));
-    disconnect(absolutePosX, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
-    disconnect(absolutePosY, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
-
     bool enable = !resolution().isEmpty();
     positionCombo->setEnabled( enable );
     positionLabel->setEnabled( enable );
@@ -478,9 +531,6 @@ void OutputConfig::updatePositionListDelayed()
     absolutePosX->setEnabled( enable );
     absolutePosY->setEnabled( enable );
 
-    positionCombo->clear();
-    positionOutputCombo->clear();
-
     OutputConfigList cleanList;
     foreach(OutputConfig *config, precedingOutputConfigs)
     {
@@ -493,37 +543,41 @@ void OutputConfig::updatePositionListDelayed()
     }
     Relation rel = Absolute;
     // FIXME: get default value from KConfig
-    if (m_unified && !cleanList.isEmpty()) {
-        positionCombo->addItem(OutputConfig::positionName(OutputConfig::SameAs), OutputConfig::SameAs);
+    QStandardItemModel *positions = new QStandardItemModel(positionCombo);
+    if (cleanList.isEmpty()) {
+        // nothing to be relative to
+        appendItem(positions, OutputConfig::positionName(OutputConfig::Absolute), OutputConfig::Absolute);
+    } else if (m_unified) {
+        appendItem(positions, OutputConfig::positionName(OutputConfig::SameAs), OutputConfig::SameAs);
+        rel = SameAs;
     } else {
         for(int i = -1; i < 5; i++)
-            positionCombo->addItem(OutputConfig::positionName((Relation)i), i);
-    }
-
-    int index = positionCombo->findData((int)rel);
-    if(index != -1) {
-        positionCombo->setCurrentIndex(index);
-    } else {
-        positionCombo->setCurrentIndex(positionCombo->findData((int)OutputConfig::SameAs));
+            appendItem(positions, OutputConfig::positionName((Relation)i), i);
     }
 
     /* Relative Output Name Configuration */
+    QStandardItemModel *outputs = new QStandardItemModel(positionOutputCombo);
     foreach(OutputConfig *config, cleanList) {
         RandROutput* output = config->output();
-        positionOutputCombo->addItem(QIcon(output->icon()), output->name(), (int)output->id());
+        appendItem(outputs, output->name(), (int)output->id(), QIcon(output->icon()));
         if (!m_unified) {
-            for( int rel = -1; rel < 5; ++rel ) {
-                if( isRelativeTo( m_output->rect(), QRect( config->position(), config->resolution()), (Relation) rel )) {
-                    positionCombo->setCurrentIndex( positionCombo->findData( rel ));
+            for( int i = -1; i < 5; ++i ) {
+                if( isRelativeTo( m_output->rect(), QRect( config->position(), config->resolution()), (Relation) i )) {
+                    rel = (Relation) i;
                 }
             }
         }
     }
-        if( positionOutputCombo->count() == 0 ) {
-            positionOutputCombo->setEnabled( false );
-            while( positionCombo->count() > 1 ) // keep only 'Absolute'
-                positionCombo->removeItem( positionCombo->count() - 1 );
-        }
+
+    QString previous = beginRebuild(positionCombo, positions);
+    positionCombo->setCurrentIndex(positionCombo->findData((int)rel));
+    bool changed = endRebuild(positionCombo, previous);
+
+    previous = beginRebuild(positionOutputCombo, outputs);
+    changed |= endRebuild(positionOutputCombo, previous);
+
+    if( positionOutputCombo->count() == 0 )
+        positionOutputCombo->setEnabled( false );
 
     if (m_unified) {
         positionLabel->setEnabled(false);
@@ -539,40 +593,36 @@ void OutputConfig::updatePositionListDelayed()
             positionOutputCombo->setCurrentIndex(index);
     }*/
 
-    connect(positionCombo,    SIGNAL(currentIndexChanged(int)), this, SLOT(setConfigDirty()));
-    connect(positionOutputCombo,    SIGNAL(currentIndexChanged(int)), this, SLOT(setConfigDirty()));
-    connect(absolutePosX, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
-    connect(absolutePosY, SIGNAL(valueChanged(int)), this, SLOT(setConfigDirty()));
+    positionComboChanged(positionCombo->currentIndex());
+    if (changed)
+    {
+        m_resolver->invalidate();
+        emit updateView();
+    }
 }
 
 void OutputConfig::updateRotationList(void)
 {
-    Q_FOREACH(OutputConfig *config, precedingOutputConfigs) {
-        if (m_unified) {
-            connect(config->orientationCombo, SIGNAL(activated(int)), orientationCombo, SLOT(setCurrentIndex(int)));
-            connect(orientationCombo, SIGNAL(activated(int)), config->orientationCombo, SLOT(setCurrentIndex(int)));
-        } else {
-            disconnect(config->orientationCombo, SIGNAL(activated(int)), orientationCombo, SLOT(setCurrentIndex(int)));
-            disconnect(orientationCombo, SIGNAL(activated(int)), config->orientationCombo, SLOT(setCurrentIndex(int)));
-        }
-    }
-
     bool enable = !resolution().isEmpty();
     orientationCombo->setEnabled( enable );
     orientationLabel->setEnabled( enable );
-    orientationCombo->clear();
+
+    QStandardItemModel *model = new QStandardItemModel(orientationCombo);
     int rotations = m_output->rotations();
     for(int i =0; i < 6; ++i) {
         int rot = (1 << i);
         if (rot & rotations) {
-            orientationCombo->addItem(QIcon(RandR::rotationIcon(rot, RandR::Rotate0)),
-                          RandR::rotationName(rot), rot);
+            appendItem(model, RandR::rotationName(rot), rot,
+                       QIcon(RandR::rotationIcon(rot, RandR::Rotate0)));
         }
     }
 
+    QString previous = beginRebuild(orientationCombo, model);
     int index = orientationCombo->findData(m_output->rotation());
     if (index != -1)
         orientationCombo->setCurrentIndex( index );
+    if (endRebuild(orientationCombo, previous))
+        emit updateView();
 }
 
 void OutputConfig::updateSizeList(void)
@@ -581,29 +631,20 @@ void OutputConfig::updateSizeList(void)
     if (m_unified) {
         sizes = m_output->screen()->unifiedSizes();
     }
-    Q_FOREACH(OutputConfig *config, precedingOutputConfigs)
-    {
-        if (m_unified) {
-            connect(config->sizeCombo, SIGNAL(activated(int)), sizeCombo, SLOT(setCurrentIndex(int)));
-            connect(sizeCombo, SIGNAL(activated(int)), config->sizeCombo, SLOT(setCurrentIndex(int)));
-        } else {
-            disconnect(config->sizeCombo, SIGNAL(activated(int)), sizeCombo, SLOT(setCurrentIndex(int)));
-            disconnect(sizeCombo, SIGNAL(activated(int)), config->sizeCombo, SLOT(setCurrentIndex(int)));
-        }
-    }
 
     RandRMode preferredMode = m_output->preferredMode();
-    sizeCombo->clear();
-    sizeCombo->addItem(tr("Disabled"), QSize(0, 0) );
+    QStandardItemModel *model = new QStandardItemModel(sizeCombo);
+    appendItem(model, tr("Disabled"), QSize(0, 0));
 
     foreach (const QSize &s, sizes) {
         QString sizeDesc = QString("%1x%2").arg(s.width()).arg(s.height());
         if (preferredMode.isValid() && s == preferredMode.size()) {
             sizeDesc = tr("%1 (Auto)").arg(sizeDesc);
         }
-        sizeCombo->addItem( sizeDesc, s );
+        appendItem(model, sizeDesc, s);
     }
 
+    QString previous = beginRebuild(sizeCombo, model);
     int index = -1;
 
     // if output is rotated 90 or 270 degrees, swap width and height before searching in combobox data
@@ -620,9 +661,12 @@ void OutputConfig::updateSizeList(void)
         sizeCombo->setCurrentIndex(index = sizeCombo->findData(sizes.first()));
     }
 
-    index = refreshCombo->findData(m_output->refreshRate());
-    if (index != -1)
-        refreshCombo->setCurrentIndex(index);
+    // the rates may differ for the same size, so they are always rebuilt;
+    // the rest only follows a different size
+    if (endRebuild(sizeCombo, previous))
+        sizeChanged(sizeCombo->currentIndex());
+    else
+        updateRateList(sizeCombo->currentIndex());
 }
 
 void OutputConfig::updateRateList(int resolutionIndex)
@@ -636,8 +680,8 @@ void OutputConfig::updateRateList(int resolutionIndex)
 
     ModeList modeList = m_output->modes();
 
-    refreshCombo->clear();
-    refreshCombo->addItem(tr("Auto"), 0.0f);
+    QStandardItemModel *model = new QStandardItemModel(refreshCombo);
+    appendItem(model, tr("Auto"), 0.0f);
     refreshCombo->setEnabled(true);
     rateLabel->setEnabled(true);
     foreach(RRMode m, modeList)
@@ -646,9 +690,15 @@ void OutputConfig::updateRateList(int resolutionIndex)
         if(outMode.isValid() && outMode.size() == resolution)
         {
             float rate = outMode.refreshRate();
-            refreshCombo->addItem(QString("%1 Hz").arg(rate));
+            appendItem(model, QString("%1 Hz").arg(rate), rate);
         }
     }
+
+    // a rebuilt list only reflects the output, it is no change of the user
+    QString previous = beginRebuild(refreshCombo, model);
+    int index = refreshCombo->findData(m_output->refreshRate());
+    refreshCombo->setCurrentIndex(index != -1 ? index : 0);
+    endRebuild(refreshCombo, previous);
 }
 
 void OutputConfig::updateRateList()
@@ -668,3 +718,10 @@ void OutputConfig::updateBrightness()
     float brightness = crtc->brightness();
     brightnessSlider->setValue(brightness*100);
 }
+
+void OutputConfig::previewBrightness(int value)
+{
+    if (!isActive())
+        return;
+    m_output->crtc()->previewBrightness((float)value / 100.0);
+}
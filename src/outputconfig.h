@@ -28,6 +28,7 @@
 #include "randroutput.h"
 
 class RandROutput;
+class OutputPositionResolver;
 
 class OutputConfig;
 typedef QList<OutputConfig*> OutputConfigList;
@@ -36,7 +37,8 @@ class OutputConfig : public QWidget, public Ui::OutputConfigBase
 {
     Q_OBJECT
 public:
-    OutputConfig(QWidget *parent, RandROutput *output, OutputConfigList preceding, bool unified);
+    OutputConfig(QWidget *parent, RandROutput *output, OutputConfigList preceding, bool unified,
+                 OutputPositionResolver *resolver);
     ~OutputConfig();
 
     /** Enumeration describing two related outputs (i.e. VGA LeftOf TMDS) */
@@ -53,6 +55,9 @@ public:
 
     bool isActive() const;
     QPoint position(void) const;
+    Relation relation(void) const;
+    RROutput relativeTo(void) const;
+    QPoint absolutePosition(void) const;
     QSize resolution(void) const;
     QRect rect() const;
     float refreshRate(void) const;
@@ -67,6 +72,9 @@ public:
 
     bool hasPendingChanges( const QPoint& normalizePos ) const;
     void setUnifyOutput(bool unified);
+
+    /** Forgets a preceding config that is about to be deleted. */
+    void removePreceding(OutputConfig *config);
 public slots:
     void load();
     void updateSizeList(void);
@@ -80,10 +88,12 @@ protected slots:
     void updateRateList(void);
     void updateRateList(int resolutionIndex);
 
+    void sizeChanged(int index);
     void positionComboChanged(int item);
     void outputChanged(RROutput output, int changed);
 
     void updateBrightness(void);
+    void previewBrightness(int value);
     void updateVirtualModeResolution(void);
     void virtualModeScaleComboChanged(int item);
     void enableVirtualMode(int);
@@ -96,6 +106,7 @@ signals:
 
 private:
     static bool isRelativeTo( QRect rect, QRect to, Relation rel );
+    void linkUnifiedCombos();
     int m_changes;
     bool m_changed;
     bool m_unified;
@@ -103,6 +114,7 @@ private:
     QTimer updatePositionListTimer;
 
     RandROutput *m_output;
+    OutputPositionResolver *m_resolver;
     // List of configs shown before this one. Relative positions may be given only
     // relative to these in order to avoid cycles.
     OutputConfigList precedingOutputConfigs;
@@ -21,6 +21,7 @@
 #include <QtGui/QFont>
 #include <QtGui/QGraphicsScene>
 #include <QtGui/QApplication>
+#include <QtGui/QPainter>
 
 #include "outputconfig.h"
 #include "outputgraphicsitem.h"
@@ -36,7 +37,12 @@ OutputGraphicsItem::OutputGraphicsItem(OutputConfig *config)
     setFlag(QGraphicsItem::ItemIsMovable, false);
 // FIXME not implemented yet	setFlag(QGraphicsItem::ItemIsSelectable, true);
 
+    // the items only change when their output is reconfigured, so render
+    // them once and let the view blit them on every other repaint
+    setCacheMode(QGraphicsItem::DeviceCoordinateCache);
+
     m_text = new QGraphicsTextItem(QString(), this);
+    m_text->setCacheMode(QGraphicsItem::DeviceCoordinateCache);
 
     QFont font = QApplication::font();
     font.setPixelSize(72);
@@ -61,15 +67,24 @@ void OutputGraphicsItem::configUpdated()
     setVisible( true );
     m_text->setVisible( true );
     calculateSetRect( m_config );
-    setBrush(QColor(0, 255, 0, 128));
+    QBrush brush(QColor(0, 255, 0, 128));
+    if (this->brush() != brush)
+        setBrush(brush);
     setObjectName(m_config->output()->name());
 
     // An example of this description text with radeonhd on randr 1.2:
     // DVI-I_2/digital
     // 1680x1050 (60.0 Hz)
     QString refresh = QString::number(m_config->refreshRate(), 'f', 1);
+    QString text = QString("%1\n%2x%3 (%4 Hz)").arg(m_config->output()->name()).arg(m_config->rect().width()).arg(m_config->rect().height()).arg(refresh);
+
+    // setting the same text again would still throw away the cached
+    // rendering of the item and repaint it
+    if (text == m_text->toPlainText() && rect() == m_textRect)
+        return;
+    m_textRect = rect();
 
-    m_text->setPlainText(QString("%1\n%2x%3 (%4 Hz)").arg(m_config->output()->name()).arg(m_config->rect().width()).arg(m_config->rect().height()).arg(refresh));
+    m_text->setPlainText(text);
     // more accurate text centering
     QRectF textRect = m_text->boundingRect();
     m_text->setPos( rect().x() + (rect().width() - textRect.width()) / 2,
@@ -305,10 +320,24 @@ void OutputGraphicsItem::setPrimary(bool primary)
 {
     QPen p=pen();
     p.setWidth(primary ? rect().width()/100 : 0);
-    setPen(p);
+    if (p != pen())
+        setPen(p);
 }
 
 bool OutputGraphicsItem::isPrimary() const
 {
     return pen().width()>0;
 }
+
+void OutputGraphicsItem::setThumbnail(const QImage &thumbnail)
+{
+    m_thumbnail = thumbnail;
+    update();
+}
+
+void OutputGraphicsItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget)
+{
+    if (!m_thumbnail.isNull())
+        painter->drawImage(rect(), m_thumbnail);
+    QGraphicsRectItem::paint(painter, option, widget);
+}
@@ -21,6 +21,7 @@
 
 #include <QtGui/QGraphicsRectItem>
 #include <QtGui/QGraphicsTextItem>
+#include <QtGui/QImage>
 
 #include "randr.h"
 
@@ -49,6 +50,12 @@ public:
     bool isPrimary() const;
     void setPrimary(bool);
 
+    /** Scaled down contents of the output, drawn under the outline; a
+     * null image turns it off. */
+    void setThumbnail(const QImage &thumbnail);
+
+    virtual void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = 0);
+
 protected:
     void disconnect();
     virtual void mousePressEvent(QGraphicsSceneMouseEvent *event);
@@ -66,6 +73,8 @@ private:
 
     OutputConfig *m_config;
     QGraphicsTextItem *m_text;
+    QImage m_thumbnail;
+    QRectF m_textRect;      // rect the text was last centered in
 
 
 };
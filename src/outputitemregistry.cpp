@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "outputitemregistry.h"
+#include "outputgraphicsitem.h"
+
+OutputItemRegistry::OutputItemRegistry()
+    : m_primary(0)
+{
+}
+
+void OutputItemRegistry::insert(OutputGraphicsItem *item, OutputConfig *config, RROutput id,
+                                const QString &name)
+{
+    Entry entry;
+    entry.id = id;
+    entry.name = name;
+    entry.config = config;
+
+    m_items.append(item);
+    m_entries.insert(item, entry);
+    m_byId.insert(id, item);
+    m_byName.insert(name, item);
+    m_byConfig.insert(config, item);
+    m_byGraphicsItem.insert(item, item);
+}
+
+void OutputItemRegistry::remove(OutputGraphicsItem *item)
+{
+    if (!m_entries.contains(item))
+        return;
+
+    // the output of the item may be gone already, so only the stored keys
+    // are used here
+    Entry entry = m_entries.take(item);
+    m_items.removeAll(item);
+    m_byId.remove(entry.id);
+    m_byName.remove(entry.name);
+    m_byConfig.remove(entry.config);
+    m_byGraphicsItem.remove(item);
+
+    if (m_primary == item)
+        m_primary = 0;
+}
+
+const QList<OutputGraphicsItem*> &OutputItemRegistry::items() const
+{
+    return m_items;
+}
+
+OutputGraphicsItem *OutputItemRegistry::item(RROutput id) const
+{
+    return m_byId.value(id);
+}
+
+OutputGraphicsItem *OutputItemRegistry::item(const QString &name) const
+{
+    return m_byName.value(name);
+}
+
+OutputGraphicsItem *OutputItemRegistry::item(const OutputConfig *config) const
+{
+    return m_byConfig.value(config);
+}
+
+OutputGraphicsItem *OutputItemRegistry::item(const QGraphicsItem *graphicsItem) const
+{
+    return m_byGraphicsItem.value(graphicsItem);
+}
+
+void OutputItemRegistry::setPrimary(const QString &name)
+{
+    OutputGraphicsItem *primary = m_byName.value(name);
+    if (m_primary && m_primary != primary && m_primary->isPrimary())
+        m_primary->setPrimary(false);
+    if (primary && !primary->isPrimary())
+        primary->setPrimary(true);
+    m_primary = primary;
+}
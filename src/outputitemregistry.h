@@ -0,0 +1,77 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OUTPUTITEMREGISTRY_H
+#define OUTPUTITEMREGISTRY_H
+
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+#include "randr.h"
+
+class QGraphicsItem;
+class OutputConfig;
+class OutputGraphicsItem;
+
+/** The OutputGraphicsItems of the config view, indexed by output XID, name,
+ * config and graphics item.
+ *
+ * The scene also holds the text children of the items, so walking
+ * QGraphicsScene::items() means allocating a list of everything and
+ * casting each entry. The view and the layout manager use this registry
+ * instead, which knows the type of its items and hands them out directly. */
+class OutputItemRegistry
+{
+public:
+    OutputItemRegistry();
+
+    void insert(OutputGraphicsItem *item, OutputConfig *config, RROutput id, const QString &name);
+    void remove(OutputGraphicsItem *item);
+
+    const QList<OutputGraphicsItem*> &items() const;
+
+    OutputGraphicsItem *item(RROutput id) const;
+    OutputGraphicsItem *item(const QString &name) const;
+    OutputGraphicsItem *item(const OutputConfig *config) const;
+
+    /** The output item @p graphicsItem is, or 0 if it is none. */
+    OutputGraphicsItem *item(const QGraphicsItem *graphicsItem) const;
+
+    /** Highlights the item of the output called @p name as the primary
+     * one. Only the previous and the new primary item are touched. */
+    void setPrimary(const QString &name);
+
+private:
+    struct Entry
+    {
+        RROutput id;
+        QString name;
+        const OutputConfig *config;
+    };
+
+    QList<OutputGraphicsItem*> m_items;
+    QHash<OutputGraphicsItem*, Entry> m_entries;
+    QHash<RROutput, OutputGraphicsItem*> m_byId;
+    QHash<QString, OutputGraphicsItem*> m_byName;
+    QHash<const OutputConfig*, OutputGraphicsItem*> m_byConfig;
+    QHash<const QGraphicsItem*, OutputGraphicsItem*> m_byGraphicsItem;
+    OutputGraphicsItem *m_primary;
+};
+
+#endif // OUTPUTITEMREGISTRY_H
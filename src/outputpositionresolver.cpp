@@ -0,0 +1,119 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDebug>
+
+#include "outputpositionresolver.h"
+#include "outputconfig.h"
+#include "randroutput.h"
+
+OutputPositionResolver::OutputPositionResolver(QObject *parent)
+    : QObject(parent),
+      m_valid(false)
+{
+}
+
+OutputPositionResolver::~OutputPositionResolver()
+{
+}
+
+void OutputPositionResolver::clear()
+{
+    m_configs.clear();
+    invalidate();
+}
+
+void OutputPositionResolver::addConfig(OutputConfig *config)
+{
+    if (m_configs.indexOf(config) != -1)
+        return;
+
+    m_configs.append(config);
+    invalidate();
+}
+
+void OutputPositionResolver::removeConfig(OutputConfig *config)
+{
+    m_configs.removeAll(config);
+    invalidate();
+}
+
+void OutputPositionResolver::invalidate()
+{
+    m_valid = false;
+}
+
+QPoint OutputPositionResolver::position(const OutputConfig *config)
+{
+    if (!m_valid)
+        resolve();
+
+    return m_positions.value(config);
+}
+
+void OutputPositionResolver::resolve()
+{
+    m_positions.clear();
+
+    // positions of the configs resolved so far, by output
+    QHash<RROutput, const OutputConfig*> resolved;
+
+    foreach(OutputConfig *config, m_configs)
+    {
+        QPoint pos;
+
+        if (!config->isActive())
+            pos = QPoint();
+        else if (config->relation() == OutputConfig::Absolute)
+            pos = config->absolutePosition();
+        else
+        {
+            const OutputConfig *related = resolved.value(config->relativeTo());
+            if (!related)
+                pos = QPoint(0, 0);
+            else
+            {
+                QPoint relatedPos = m_positions.value(related);
+                switch (config->relation())
+                {
+                    case OutputConfig::LeftOf:
+                        pos = QPoint(relatedPos.x() - config->resolution().width(), relatedPos.y());
+                        break;
+                    case OutputConfig::RightOf:
+                        pos = QPoint(relatedPos.x() + related->resolution().width(), relatedPos.y());
+                        break;
+                    case OutputConfig::Over:
+                        pos = QPoint(relatedPos.x(), relatedPos.y() - config->resolution().height());
+                        break;
+                    case OutputConfig::Under:
+                        pos = QPoint(relatedPos.x(), relatedPos.y() + related->resolution().height());
+                        break;
+                    case OutputConfig::SameAs:
+                    default:
+                        pos = relatedPos;
+                        break;
+                }
+            }
+        }
+
+        m_positions.insert(config, pos);
+        resolved.insert(config->output()->id(), config);
+    }
+
+    m_valid = true;
+}
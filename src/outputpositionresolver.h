@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OUTPUTPOSITIONRESOLVER_H
+#define OUTPUTPOSITIONRESOLVER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPoint>
+
+class OutputConfig;
+
+/** Resolves the positions of all OutputConfigs of a dialog at once.
+ *
+ * Relative positions may only refer to preceding configs, so a single pass
+ * in config order resolves every position. The result is cached until one
+ * of the inputs (size, relation, related output or absolute position) of
+ * any config changes. */
+class OutputPositionResolver : public QObject
+{
+    Q_OBJECT
+public:
+    OutputPositionResolver(QObject *parent = 0);
+    ~OutputPositionResolver();
+
+    void clear();
+    void addConfig(OutputConfig *config);
+    void removeConfig(OutputConfig *config);
+
+    QPoint position(const OutputConfig *config);
+
+public slots:
+    void invalidate();
+
+private:
+    void resolve();
+
+    QList<OutputConfig*> m_configs;
+    QHash<const OutputConfig*, QPoint> m_positions;
+    bool m_valid;
+};
+
+#endif // OUTPUTPOSITIONRESOLVER_H
@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QtAlgorithms>
+#include <math.h>
+
+#include "outputsnapindex.h"
+
+OutputSnapIndex::OutputSnapIndex()
+    : m_threshold(64)
+{
+}
+
+void OutputSnapIndex::clear()
+{
+    m_rects.clear();
+    m_ids.clear();
+    m_left.clear();
+    m_right.clear();
+    m_top.clear();
+    m_bottom.clear();
+}
+
+void OutputSnapIndex::insert(int id, const QRectF &rect)
+{
+    Edge e;
+    e.rect = m_rects.count();
+
+    e.pos = rect.left();
+    m_left.append(e);
+    e.pos = rect.right();
+    m_right.append(e);
+    e.pos = rect.top();
+    m_top.append(e);
+    e.pos = rect.bottom();
+    m_bottom.append(e);
+
+    m_rects.append(rect);
+    m_ids.append(id);
+}
+
+void OutputSnapIndex::build()
+{
+    qSort(m_left);
+    qSort(m_right);
+    qSort(m_top);
+    qSort(m_bottom);
+}
+
+void OutputSnapIndex::setThreshold(qreal threshold)
+{
+    m_threshold = threshold;
+}
+
+qreal OutputSnapIndex::threshold() const
+{
+    return m_threshold;
+}
+
+OutputSnapIndex::Snap OutputSnapIndex::nearest(const QRectF &rect) const
+{
+    Snap best;
+    best.id = -1;
+    best.side = SnapTop;
+    best.distance = 0;
+    best.aligned = false;
+    best.alignment = LayoutSolver::AlignStart;
+
+    // the dragged output's top faces the bottom edges of the others and so
+    // on; on a tie the sides are preferred in this order
+    search(m_bottom, rect.top(), rect, SnapTop, best);
+    search(m_top, rect.bottom(), rect, SnapBottom, best);
+    search(m_right, rect.left(), rect, SnapLeft, best);
+    search(m_left, rect.right(), rect, SnapRight, best);
+
+    if (best.id == -1)
+        return best;
+
+    align(rect, m_rects.at(best.id), best);
+    best.id = m_ids.at(best.id);
+    return best;
+}
+
+void OutputSnapIndex::search(const QVector<Edge> &edges, qreal pos, const QRectF &rect,
+                             Side side, Snap &best) const
+{
+    if (edges.isEmpty())
+        return;
+
+    Edge key;
+    key.pos = pos;
+    key.rect = -1;
+    QVector<Edge>::const_iterator start = qLowerBound(edges.constBegin(), edges.constEnd(), key);
+
+    // walk down and up from the insertion point; edges further away than the
+    // best distance can't be closer, whatever their perpendicular offset
+    for (QVector<Edge>::const_iterator it = start; it != edges.constBegin();)
+    {
+        --it;
+        if (best.id != -1 && pos - it->pos >= best.distance)
+            break;
+
+        qreal d = distance(rect, m_rects.at(it->rect), side);
+        if (best.id == -1 || d < best.distance)
+        {
+            best.id = it->rect;
+            best.side = side;
+            best.distance = d;
+        }
+    }
+
+    for (QVector<Edge>::const_iterator it = start; it != edges.constEnd(); ++it)
+    {
+        if (best.id != -1 && it->pos - pos >= best.distance)
+            break;
+
+        qreal d = distance(rect, m_rects.at(it->rect), side);
+        if (best.id == -1 || d < best.distance)
+        {
+            best.id = it->rect;
+            best.side = side;
+            best.distance = d;
+        }
+    }
+}
+
+qreal OutputSnapIndex::distance(const QRectF &rect, const QRectF &target, Side side) const
+{
+    qreal gap = 0;
+    qreal miss = 0;
+
+    switch (side)
+    {
+        case SnapLeft:
+            gap = rect.left() - target.right();
+            break;
+        case SnapRight:
+            gap = target.left() - rect.right();
+            break;
+        case SnapTop:
+            gap = rect.top() - target.bottom();
+            break;
+        case SnapBottom:
+            gap = target.top() - rect.bottom();
+            break;
+    }
+
+    if (side == SnapLeft || side == SnapRight)
+        miss = qMax(qreal(0), qMax(target.top() - rect.bottom(), rect.top() - target.bottom()));
+    else
+        miss = qMax(qreal(0), qMax(target.left() - rect.right(), rect.left() - target.right()));
+
+    return fabs(gap) + miss;
+}
+
+void OutputSnapIndex::align(const QRectF &rect, const QRectF &target, Snap &snap) const
+{
+    qreal start, center, end;
+
+    if (snap.side == SnapLeft || snap.side == SnapRight)
+    {
+        start = fabs(rect.top() - target.top());
+        center = fabs(rect.center().y() - target.center().y());
+        end = fabs(rect.bottom() - target.bottom());
+    }
+    else
+    {
+        start = fabs(rect.left() - target.left());
+        center = fabs(rect.center().x() - target.center().x());
+        end = fabs(rect.right() - target.right());
+    }
+
+    snap.alignment = LayoutSolver::AlignStart;
+    qreal nearest = start;
+    if (center < nearest)
+    {
+        snap.alignment = LayoutSolver::AlignCenter;
+        nearest = center;
+    }
+    if (end < nearest)
+    {
+        snap.alignment = LayoutSolver::AlignEnd;
+        nearest = end;
+    }
+
+    snap.aligned = nearest <= m_threshold;
+    if (!snap.aligned)
+        snap.alignment = LayoutSolver::AlignStart;
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OUTPUTSNAPINDEX_H
+#define OUTPUTSNAPINDEX_H
+
+#include <QtCore/QRectF>
+#include <QtCore/QVector>
+
+#include "layoutsolver.h"
+
+/** Finds the output edge nearest to a dragged output.
+ *
+ * The left, right, top and bottom edges of all outputs are kept in four
+ * sorted arrays, so the search for the edge facing each side of the dragged
+ * rectangle starts with a binary search and only walks outwards while an
+ * edge can still be closer than the best one found. The distance to an edge
+ * is the gap between the two edges plus how far the rectangles miss each
+ * other along the edge, so an output snaps to the side it actually touches
+ * rather than to the output with the nearest center.
+ *
+ * Along the shared edge the outputs are aligned at their start, center or
+ * end when those are within the magnetic threshold of each other. */
+class OutputSnapIndex
+{
+public:
+    enum Side {
+        SnapLeft,   // the target is left of the dragged output
+        SnapRight,
+        SnapTop,
+        SnapBottom
+    };
+
+    struct Snap
+    {
+        int id;             // -1 if the index is empty
+        Side side;
+        qreal distance;
+        bool aligned;       // alignment is within the threshold
+        LayoutSolver::Alignment alignment;
+    };
+
+    OutputSnapIndex();
+
+    void clear();
+    void insert(int id, const QRectF &rect);
+
+    /** Sorts the edges, must be called after the last insert(). */
+    void build();
+
+    /** Distance in scene units, i.e. output pixels, within which edges
+     * line up; 64 by default. */
+    void setThreshold(qreal threshold);
+    qreal threshold() const;
+
+    Snap nearest(const QRectF &rect) const;
+
+private:
+    struct Edge
+    {
+        qreal pos;
+        int rect;
+        bool operator<(const Edge &other) const { return pos < other.pos; }
+    };
+
+    void search(const QVector<Edge> &edges, qreal pos, const QRectF &rect,
+                Side side, Snap &best) const;
+    qreal distance(const QRectF &rect, const QRectF &target, Side side) const;
+    void align(const QRectF &rect, const QRectF &target, Snap &snap) const;
+
+    QVector<QRectF> m_rects;
+    QVector<int> m_ids;
+    QVector<Edge> m_left;
+    QVector<Edge> m_right;
+    QVector<Edge> m_top;
+    QVector<Edge> m_bottom;
+    qreal m_threshold;
+};
+
+#endif // OUTPUTSNAPINDEX_H
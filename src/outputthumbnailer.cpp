@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDebug>
+#include <QtCore/QSysInfo>
+#include <QtGui/QX11Info>
+
+#ifdef HAS_XSHM
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#endif
+
+#include "outputthumbnailer.h"
+
+OutputThumbnailer::OutputThumbnailer(QObject *parent)
+    : QObject(parent),
+      m_current(0),
+      m_thumbnailSize(256),
+      m_pixelRate(1000000),
+      m_image(0),
+      m_imageRows(0)
+{
+    m_timer.setInterval(250);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(capture()));
+}
+
+OutputThumbnailer::~OutputThumbnailer()
+{
+    releaseImage();
+}
+
+bool OutputThumbnailer::isSupported()
+{
+#ifdef HAS_XSHM
+    return XShmQueryExtension(QX11Info::display());
+#else
+    return false;
+#endif
+}
+
+void OutputThumbnailer::setThumbnailSize(int size)
+{
+    m_thumbnailSize = qMax(1, size);
+}
+
+void OutputThumbnailer::setPixelRate(int pixels)
+{
+    m_pixelRate = qMax(1, pixels);
+}
+
+void OutputThumbnailer::setRegion(ulong id, const QRect &rect)
+{
+    Display *dpy = QX11Info::display();
+    int screen = QX11Info::appScreen();
+    QRect root(0, 0, DisplayWidth(dpy, screen), DisplayHeight(dpy, screen));
+    QRect r = rect.intersected(root);
+    if (r.isEmpty())
+    {
+        removeRegion(id);
+        return;
+    }
+
+    if (m_regions.contains(id) && m_regions.value(id).rect == r)
+        return;
+
+    Region region;
+    region.rect = r;
+    region.box = qMax(1, (qMax(r.width(), r.height()) + m_thumbnailSize - 1) / m_thumbnailSize);
+    region.row = 0;
+    region.thumbnail = QImage((r.width() + region.box - 1) / region.box,
+                              (r.height() + region.box - 1) / region.box, QImage::Format_RGB32);
+    region.thumbnail.fill(0);
+    m_regions.insert(id, region);
+}
+
+void OutputThumbnailer::removeRegion(ulong id)
+{
+    m_regions.remove(id);
+}
+
+void OutputThumbnailer::clear()
+{
+    m_regions.clear();
+}
+
+bool OutputThumbnailer::isEnabled() const
+{
+    return m_timer.isActive();
+}
+
+void OutputThumbnailer::setEnabled(bool enabled)
+{
+    if (enabled && isSupported())
+    {
+        m_timer.start();
+        return;
+    }
+
+    m_timer.stop();
+    releaseImage();
+}
+
+void OutputThumbnailer::capture()
+{
+    if (m_regions.isEmpty())
+        return;
+
+    QMap<ulong, Region>::iterator it = m_regions.find(m_current);
+    if (it == m_regions.end())
+    {
+        it = m_regions.begin();
+        m_current = it.key();
+    }
+    Region &region = it.value();
+
+    // whole rows of boxes, as many as the pixel rate allows in one tick
+    int width = region.rect.width();
+    int pixels = m_pixelRate / 1000 * m_timer.interval();
+    int rows = qMax(1, pixels / width / region.box) * region.box;
+    rows = qMin(rows, region.rect.height() - region.row);
+
+    if (!captureStripe(QRect(region.rect.x(), region.rect.y() + region.row, width, rows)))
+    {
+        qDebug() << "Capturing thumbnails failed, turning them off";
+        setEnabled(false);
+        return;
+    }
+    reduceStripe(region, rows);
+
+    region.row += rows;
+    if (region.row < region.rect.height())
+        return;
+
+    // done with this region, go on with the next one
+    region.row = 0;
+    ulong id = it.key();
+    QImage thumbnail = region.thumbnail;
+    ++it;
+    m_current = (it == m_regions.end()) ? m_regions.begin().key() : it.key();
+
+    emit thumbnailUpdated(id, thumbnail);
+}
+
+bool OutputThumbnailer::createImage(int width, int rows)
+{
+#ifdef HAS_XSHM
+    Display *dpy = QX11Info::display();
+    int screen = QX11Info::appScreen();
+
+    m_image = XShmCreateImage(dpy, DefaultVisual(dpy, screen), DefaultDepth(dpy, screen),
+                              ZPixmap, 0, &m_shm, width, rows);
+    if (!m_image)
+        return false;
+
+    // the filter reads the pixels as native 0xRRGGBB words
+    int byteOrder = (QSysInfo::ByteOrder == QSysInfo::LittleEndian) ? LSBFirst : MSBFirst;
+    if (m_image->bits_per_pixel != 32 || m_image->byte_order != byteOrder
+        || m_image->red_mask != 0xff0000 || m_image->green_mask != 0xff00
+        || m_image->blue_mask != 0xff)
+    {
+        XDestroyImage(m_image);
+        m_image = 0;
+        return false;
+    }
+
+    m_shm.shmid = shmget(IPC_PRIVATE, m_image->bytes_per_line * m_image->height, IPC_CREAT | 0600);
+    if (m_shm.shmid == -1)
+    {
+        XDestroyImage(m_image);
+        m_image = 0;
+        return false;
+    }
+
+    m_shm.shmaddr = m_image->data = (char *) shmat(m_shm.shmid, 0, 0);
+    m_shm.readOnly = False;
+    if (m_shm.shmaddr == (char *) -1 || !XShmAttach(dpy, &m_shm))
+    {
+        if (m_shm.shmaddr != (char *) -1)
+            shmdt(m_shm.shmaddr);
+        shmctl(m_shm.shmid, IPC_RMID, 0);
+        m_image->data = 0;
+        XDestroyImage(m_image);
+        m_image = 0;
+        return false;
+    }
+    XSync(dpy, False);
+
+    // the segment is freed once both sides detached from it
+    shmctl(m_shm.shmid, IPC_RMID, 0);
+    m_imageRows = rows;
+    return true;
+#else
+    Q_UNUSED(width);
+    Q_UNUSED(rows);
+    return false;
+#endif
+}
+
+void OutputThumbnailer::releaseImage()
+{
+#ifdef HAS_XSHM
+    if (!m_image)
+        return;
+
+    XShmDetach(QX11Info::display(), &m_shm);
+    shmdt(m_shm.shmaddr);
+    m_image->data = 0;
+    XDestroyImage(m_image);
+    m_image = 0;
+    m_imageRows = 0;
+#endif
+}
+
+bool OutputThumbnailer::captureStripe(const QRect &stripe)
+{
+#ifdef HAS_XSHM
+    // the stride of the image follows its width, so only a change of the
+    // width or more rows need a new image; fewer rows are captured by
+    // lowering the height
+    if (m_image && (m_image->width != stripe.width() || m_imageRows < stripe.height()))
+        releaseImage();
+    if (!m_image && !createImage(stripe.width(), stripe.height()))
+        return false;
+
+    m_image->height = stripe.height();
+    return XShmGetImage(QX11Info::display(), QX11Info::appRootWindow(), m_image,
+                        stripe.x(), stripe.y(), AllPlanes);
+#else
+    Q_UNUSED(stripe);
+    return false;
+#endif
+}
+
+void OutputThumbnailer::reduceStripe(Region &region, int rows)
+{
+    const int width = region.rect.width();
+    const int box = region.box;
+    const int stride = m_image->bytes_per_line / 4;
+    const quint32 *data = reinterpret_cast<const quint32 *>(m_image->data);
+
+    m_red.resize(width);
+    m_green.resize(width);
+    m_blue.resize(width);
+    quint32 *red = m_red.data();
+    quint32 *green = m_green.data();
+    quint32 *blue = m_blue.data();
+
+    for (int y0 = 0; y0 < rows; y0 += box)
+    {
+        int boxRows = qMin(box, rows - y0);
+        m_red.fill(0);
+        m_green.fill(0);
+        m_blue.fill(0);
+
+        // sum the rows of the box per column; one array per channel keeps
+        // the loop free of dependencies between columns, so the compiler
+        // turns it into vector instructions
+        for (int y = y0; y < y0 + boxRows; ++y)
+        {
+            const quint32 *src = data + y * stride;
+            for (int x = 0; x < width; ++x)
+            {
+                quint32 p = src[x];
+                red[x] += (p >> 16) & 0xff;
+                green[x] += (p >> 8) & 0xff;
+                blue[x] += p & 0xff;
+            }
+        }
+
+        // then the columns of each box
+        QRgb *dst = reinterpret_cast<QRgb *>(region.thumbnail.scanLine((region.row + y0) / box));
+        for (int tx = 0; tx < region.thumbnail.width(); ++tx)
+        {
+            int x0 = tx * box;
+            int x1 = qMin(x0 + box, width);
+            quint32 r = 0, g = 0, b = 0;
+            for (int x = x0; x < x1; ++x)
+            {
+                r += red[x];
+                g += green[x];
+                b += blue[x];
+            }
+            quint32 n = (x1 - x0) * boxRows;
+            dst[tx] = qRgb(r / n, g / n, b / n);
+        }
+    }
+}
@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef OUTPUTTHUMBNAILER_H
+#define OUTPUTTHUMBNAILER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QTimer>
+#include <QtCore/QVector>
+#include <QtGui/QImage>
+#include <config-randr.h>
+
+#include <X11/Xlib.h>
+#ifdef HAS_XSHM
+#include <X11/extensions/XShm.h>
+#endif
+
+/** Keeps small thumbnails of regions of the root window up to date.
+ *
+ * The regions are captured through MIT-SHM in horizontal stripes, a few at
+ * a time, so that no more than a fixed number of framebuffer pixels is read
+ * per second whatever the size of the framebuffer; a large output simply
+ * takes longer to refresh. Each stripe is reduced with a box filter right
+ * away, so only the reused stripe image and one row of sums are kept. */
+class OutputThumbnailer : public QObject
+{
+    Q_OBJECT
+public:
+    OutputThumbnailer(QObject *parent = 0);
+    ~OutputThumbnailer();
+
+    /** Whether the X server and visual allow capturing thumbnails. */
+    static bool isSupported();
+
+    /** Longest side of the thumbnails in pixels. */
+    void setThumbnailSize(int size);
+
+    /** Framebuffer pixels read per second. */
+    void setPixelRate(int pixels);
+
+    void setRegion(ulong id, const QRect &rect);
+    void removeRegion(ulong id);
+    void clear();
+
+    bool isEnabled() const;
+
+public slots:
+    void setEnabled(bool enabled);
+
+signals:
+    void thumbnailUpdated(ulong id, const QImage &thumbnail);
+
+private slots:
+    void capture();
+
+private:
+    struct Region
+    {
+        QRect rect;
+        int box;            // side of the box of pixels averaged into one
+        int row;            // next row to capture, relative to the rect
+        QImage thumbnail;
+    };
+
+    bool createImage(int width, int rows);
+    bool captureStripe(const QRect &stripe);
+    void reduceStripe(Region &region, int rows);
+    void releaseImage();
+
+    QTimer m_timer;
+    QMap<ulong, Region> m_regions;
+    ulong m_current;
+    int m_thumbnailSize;
+    int m_pixelRate;
+
+    // per source column sums of the box rows being reduced
+    QVector<quint32> m_red;
+    QVector<quint32> m_green;
+    QVector<quint32> m_blue;
+
+    XImage *m_image;
+    int m_imageRows;
+#ifdef HAS_XSHM
+    XShmSegmentInfo m_shm;
+#endif
+};
+
+#endif // OUTPUTTHUMBNAILER_H
@@ -19,12 +19,24 @@
  */
 
 #include <QtGui/QIcon>
+#include <QtGui/QPixmapCache>
 #include "qtimerconfirmdialog.h"
 #include "randr.h"
 
 bool RandR::has_1_2 = true;
 bool RandR::has_1_3 = true;
 Time RandR::timestamp = 0;
+bool RandR::probe_async = false;
+
+RandRCapabilities::RandRCapabilities()
+    : eventBase(0),
+      errorBase(0),
+      gamma(false),
+      panning(false),
+      transform(false),
+      primary(false)
+{
+}
 
 QString RandR::rotationName(int rotation, bool pastTense, bool capitalised)
 {
@@ -82,6 +94,13 @@ QString RandR::rotationName(int rotation, bool pastTense, bool capitalised)
 
 QPixmap RandR::rotationIcon(int rotation, int currentRotation)
 {
+    // The icons are decoded once and every orientation they are asked for
+    // is resolved once; callers get shared copies from the pixmap cache.
+    QString key = QString("lxqt-randr-rotation-%1-%2").arg(rotation).arg(currentRotation);
+    QPixmap icon;
+    if (QPixmapCache::find(key, &icon))
+        return icon;
+
     // Adjust icons for current screen orientation
     if (!(currentRotation & RR_Rotate_0) && rotation & (RR_Rotate_0 | RR_Rotate_90 | RR_Rotate_180 | RR_Rotate_270)) {
         int currentAngle = currentRotation & (RR_Rotate_90 | RR_Rotate_180 | RR_Rotate_270);
@@ -103,22 +122,38 @@ QPixmap RandR::rotationIcon(int rotation, int currentRotation)
         }
     }
 
+    QString file;
     switch (rotation) {
         case RR_Rotate_0:
-        return QPixmap(":/images/go-up.png");
+            file = ":/images/go-up.png";
+            break;
         case RR_Rotate_90:
-            return QPixmap(":/images/go-previous.png");
+            file = ":/images/go-previous.png";
+            break;
         case RR_Rotate_180:
-            return QPixmap(":/images/go-down.png");
+            file = ":/images/go-down.png";
+            break;
         case RR_Rotate_270:
-            return QPixmap(":/images/go-next.png");
+            file = ":/images/go-next.png";
+            break;
         case RR_Reflect_X:
-            return QPixmap(":/images/object-flip-horizontal.png");
+            file = ":/images/object-flip-horizontal.png";
+            break;
         case RR_Reflect_Y:
-            return QPixmap(":/images/object-flip-vertical.png");
+            file = ":/images/object-flip-vertical.png";
+            break;
         default:
-            return QPixmap(":/images/process-stop.png");
+            file = ":/images/process-stop.png";
+            break;
+    }
+
+    if (!QPixmapCache::find(file, &icon))
+    {
+        icon.load(file);
+        QPixmapCache::insert(file, icon);
     }
+    QPixmapCache::insert(key, icon);
+    return icon;
 }
 
 bool RandR::confirm(const QRect &rect)
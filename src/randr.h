@@ -53,6 +53,22 @@ typedef QList<QSize> SizeList;
 class LegacyRandRScreen;
 typedef QList<LegacyRandRScreen*> LegacyScreenList;
 
+/**
+ * What the server's RandR extension supports. Probed once per connection
+ * by RandRDisplay, which hands it to its screens.
+ */
+struct RandRCapabilities
+{
+    RandRCapabilities();
+
+    int eventBase;
+    int errorBase;
+    bool gamma;
+    bool panning;
+    bool transform;
+    bool primary;
+};
+
 class RandR
 {
 public:
@@ -60,6 +76,10 @@ public:
     static bool has_1_3;
     static Time timestamp;
 
+    // set by the dialog: outputs are only probed by the RandRWorker, which
+    // starts after the first load
+    static bool probe_async;
+
     static const int OrientationCount = 6;
     static const int RotationCount    = 4;
 
@@ -85,7 +105,8 @@ public:
         ChangeRect       = 0x20,
         ChangeRate       = 0x40,
         ChangeBrightness = 0x80,
-        ChangeVirtualRect = 0x100
+        ChangeVirtualRect = 0x100,
+        ChangeTransform  = 0x200
     };
 
     static QString rotationName(int rotation, bool pastTense = false, bool capitalised = true);
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QEvent>
+#include <QtCore/QTimer>
+#include <QtGui/QApplication>
+#include <QtGui/QWidget>
+#include <stdio.h>
+
+#include "randrbenchmark.h"
+
+RandRBenchmark *RandRBenchmark::s_instance = 0;
+
+RandRBenchmark::RandRBenchmark(const QElapsedTimer &clock)
+    : m_clock(clock),
+      m_window(0),
+      m_viewUpdated(false)
+{
+}
+
+void RandRBenchmark::start(const QElapsedTimer &clock)
+{
+    if (!s_instance)
+        s_instance = new RandRBenchmark(clock);
+}
+
+bool RandRBenchmark::isActive()
+{
+    return s_instance != 0;
+}
+
+void RandRBenchmark::watch(QWidget *window)
+{
+    if (!s_instance)
+        return;
+
+    // the paint that matters is usually that of the graphics view only, so
+    // watch the paints of every widget rather than those of the window
+    s_instance->m_window = window;
+    qApp->installEventFilter(s_instance);
+}
+
+void RandRBenchmark::viewUpdated()
+{
+    if (s_instance)
+        s_instance->m_viewUpdated = true;
+}
+
+RandRBenchmark::Phase::Phase(const char *name)
+    : m_name(name),
+      m_start(s_instance ? s_instance->elapsed() : -1)
+{
+}
+
+RandRBenchmark::Phase::~Phase()
+{
+    if (s_instance && m_start >= 0)
+        s_instance->record(m_name, m_start, s_instance->elapsed());
+}
+
+bool RandRBenchmark::eventFilter(QObject *obj, QEvent *event)
+{
+    // the view is only fitted to the outputs once the coalesced update ran,
+    // so paints before it do not show the final dialog yet
+    if (m_viewUpdated && event->type() == QEvent::Paint && obj->isWidgetType()
+            && static_cast<QWidget*>(obj)->window() == m_window)
+    {
+        // the rest of the window is painted and flushed right after
+        qApp->removeEventFilter(this);
+        QTimer::singleShot(0, this, SLOT(painted()));
+    }
+    return QObject::eventFilter(obj, event);
+}
+
+void RandRBenchmark::painted()
+{
+    report(elapsed());
+    qApp->quit();
+}
+
+qint64 RandRBenchmark::elapsed() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+void RandRBenchmark::record(const char *name, qint64 start, qint64 end)
+{
+    for (int i = 0; i < m_records.count(); ++i)
+    {
+        Record &record = m_records[i];
+        if (record.name == name)
+        {
+            record.calls++;
+            record.total += end - start;
+            return;
+        }
+    }
+
+    Record record;
+    record.name = name;
+    record.calls = 1;
+    record.first = start;
+    record.total = end - start;
+    m_records.append(record);
+}
+
+void RandRBenchmark::report(qint64 total) const
+{
+    printf("%-32s %6s %12s %12s\n", "phase", "calls", "first at", "total");
+    foreach(const Record &record, m_records)
+    {
+        printf("%-32s %6d %9.2f ms %9.2f ms\n", record.name.constData(), record.calls,
+               record.first / 1e6, record.total / 1e6);
+    }
+    printf("%-32s %6s %12s %9.2f ms\n", "first full paint", "", "", total / 1e6);
+    puts("Phases nest, so their times do not add up to the total.");
+    fflush(stdout);
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRBENCHMARK_H
+#define RANDRBENCHMARK_H
+
+#include <QtCore/QObject>
+#include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+
+class QWidget;
+
+/** Measures how long the dialog takes from start until it shows the outputs.
+ *
+ * Code marks the phases of interest with a Phase on the stack; their times
+ * are only recorded once start() was called, so the markers cost nothing
+ * otherwise. The clock is monotonic. Phases nest, e.g. OutputConfig::load
+ * runs inside RandRConfig::load, and repeated phases are summed up. */
+class RandRBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    /** Starts recording; times are taken relative to the given clock,
+     * which should have been started when the program was. */
+    static void start(const QElapsedTimer &clock);
+    static bool isActive();
+
+    /** Prints the report and quits the application once the window was
+     * painted after its view was first fitted to the outputs. */
+    static void watch(QWidget *window);
+
+    /** Marks the view as fitted; the next paint of the window ends the run. */
+    static void viewUpdated();
+
+    /** Adds its lifetime to the phase of the given name. */
+    class Phase
+    {
+    public:
+        Phase(const char *name);
+        ~Phase();
+
+    private:
+        const char *m_name;
+        qint64 m_start;
+    };
+
+protected:
+    bool eventFilter(QObject *obj, QEvent *event);
+
+private slots:
+    void painted();
+
+private:
+    RandRBenchmark(const QElapsedTimer &clock);
+
+    struct Record
+    {
+        QByteArray name;
+        int calls;
+        qint64 first;       // start of the first call
+        qint64 total;
+    };
+
+    qint64 elapsed() const;
+    void record(const char *name, qint64 start, qint64 end);
+    void report(qint64 total) const;
+
+    static RandRBenchmark *s_instance;
+
+    QElapsedTimer m_clock;
+    QList<Record> m_records;
+    QWidget *m_window;
+    bool m_viewUpdated;
+};
+
+#endif // RANDRBENCHMARK_H
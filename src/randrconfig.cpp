@@ -19,15 +19,21 @@
 
 #include <QtGui/QMessageBox>
 #include <QtGui/QMenu>
+#include <QtGui/QLabel>
 
 #include "collapsiblewidget.h"
 #include "outputconfig.h"
+#include "outputpositionresolver.h"
 #include "outputgraphicsitem.h"
 #include "layoutmanager.h"
 #include "randrconfig.h"
 #include "randroutput.h"
 #include "randrdisplay.h"
 #include "randrscreen.h"
+#include "randrconfigstore.h"
+#include "randrworker.h"
+#include "outputthumbnailer.h"
+#include "randrbenchmark.h"
 
 RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
     : QWidget(parent), Ui::RandRConfigBase()
@@ -75,12 +81,7 @@ RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
         label->setVisible(false);
     }
 
-    QSettings config;
-    config.beginGroup("Screen_0");
-    bool outputunified = config.value("OutputsUnified", false).toBool();
-    config.endGroup();
-
-    if (outputunified)
+    if (m_display->currentScreen()->outputsUnified())
     {
         unifyOutputs->setChecked(true);
     }
@@ -90,33 +91,73 @@ RandRConfig::RandRConfig(QWidget *parent, RandRDisplay *display)
 
     m_scene = new QGraphicsScene(m_display->currentScreen()->rect(), screenView);
     screenView->setScene(m_scene);
+    screenView->setCacheMode(QGraphicsView::CacheBackground);
+    screenView->setViewportUpdateMode(QGraphicsView::MinimalViewportUpdate);
     screenView->installEventFilter(this);
 
-    m_layoutManager = new LayoutManager(m_display->currentScreen(), m_scene);
+    m_layoutManager = new LayoutManager(m_display->currentScreen(), m_scene, &m_itemRegistry);
+    m_positionResolver = new OutputPositionResolver(this);
+
+    m_thumbnailer = new OutputThumbnailer(this);
+    showThumbnails->setVisible(OutputThumbnailer::isSupported());
+    connect(showThumbnails, SIGNAL(toggled(bool)), SLOT(showThumbnailsChanged(bool)));
+    connect(m_thumbnailer, SIGNAL(thumbnailUpdated(ulong,QImage)),
+            SLOT(thumbnailUpdated(ulong,QImage)));
     qDebug() << "Terminated constructor Config";
 
     load();
+
+    // the objects of outputs that vanish are deleted, so their widgets
+    // have to go right away
+    RandRScreen *screen = m_display->currentScreen();
+    connect(screen, SIGNAL(outputsReclaimed()), this, SLOT(slotOutputsReclaimed()), Qt::DirectConnection);
+    connect(screen, SIGNAL(configChanged()), this, SLOT(slotConfigChanged()));
+
+    if (RandR::probe_async)
+    {
+        // the outputs were loaded without polling them; poll them now
+        // without blocking the dialog and reload if anything changed
+        connect(RandRWorker::instance(), SIGNAL(probed(int,ulong,ulong)),
+                this, SLOT(slotProbed(int,ulong,ulong)));
+        RandRWorker::instance()->probe(m_display->currentScreen()->index());
+    }
 }
 
 RandRConfig::~RandRConfig()
 {
     clearIndicators();
+    cancelPreviews();
+}
+
+void RandRConfig::cancelPreviews()
+{
+    // brightness that was only previewed goes back to what it was
+    if (!m_display->isValid())
+        return;
+
+    foreach(RandROutput *output, m_display->currentScreen()->outputs())
+    {
+        if (output->crtc())
+            output->crtc()->cancelPreview();
+    }
 }
 
 void RandRConfig::load(void)
 {
+    RandRBenchmark::Phase phase("RandRConfig::load");
     if (!m_display->isValid())
     {
         qDebug() << "Invalid display! Aborting config load.";
         return;
     }
 
-    m_scene->clear();
-    qDeleteAll(m_outputList);
-    m_outputList.clear();
-    m_configs.clear(); // objects deleted above
-
     OutputMap outputs = m_display->currentScreen()->outputs();
+
+    // reconcile the widgets with the outputs instead of rebuilding them:
+    // drop the ones of vanished outputs first, so that no config refers to
+    // them as a preceding one anymore
+    removeVanishedRows();
+
 #ifdef HAS_RANDR_1_3
     RandROutput *primary = m_display->currentScreen()->primaryOutput();
     if (RandR::has_1_3)
@@ -130,34 +171,30 @@ void RandRConfig::load(void)
 #endif //HAS_RANDR_1_3
 
     // FIXME: adjust it to run on a multi screen system
-    CollapsibleWidget *w;
-    OutputGraphicsItem *o;
-    OutputConfigList preceding;
     foreach(RandROutput *output, outputs)
     {
-        OutputConfig *config = new OutputConfig(this, output, preceding, unifyOutputs->isChecked());
-        m_configs.append( config );
-        preceding.append( config );
-
-        QString description = output->isConnected()
-            ? tr("%1 (Connected)").arg(output->name())
-            : output->name();
-        w = m_container->insertWidget(config, description);
-        if(output->isConnected()) {
-            w->setExpanded(true);
-            qDebug() << "Output rect:" << output->rect();
+        int index = indexOfOutput(output);
+        if (index == -1)
+        {
+            addOutputRow(output);
+        }
+        else
+        {
+            // update the existing widgets in place; placeholders only need
+            // a panel once their output is connected
+            OutputConfig *config = configAt(index);
+            if (config)
+            {
+                config->setUnifyOutput(unifyOutputs->isChecked());
+                config->load();
+            }
+            else if (output->isConnected())
+            {
+                buildOutputConfig(index);
+                m_outputList.at(index)->setExpanded(true);
+            }
+            updateCaption(index);
         }
-        connect(config, SIGNAL(connectedChanged(bool)), this, SLOT(outputConnectedChanged(bool)));
-        m_outputList.append(w);
-
-        o = new OutputGraphicsItem(config);
-        m_scene->addItem(o);
-
-        connect(o,    SIGNAL(itemChanged(OutputGraphicsItem*)),
-                this, SLOT(slotAdjustOutput(OutputGraphicsItem*)));
-
-        connect(config, SIGNAL(updateView()), this, SLOT(slotUpdateView()));
-        connect(config, SIGNAL(optionChanged()), this, SIGNAL(changed()));
 
 #ifdef HAS_RANDR_1_3
         if (RandR::has_1_3 && output->isConnected())
@@ -180,25 +217,194 @@ void RandRConfig::load(void)
     slotUpdateView();
 }
 
-void RandRConfig::outputConnectedChanged(bool connected)
+void RandRConfig::outputConnectedChanged(bool)
 {
     OutputConfig *config = static_cast <OutputConfig *> (sender());
-    int index = m_configs.indexOf(config);
-    QString description = connected
-            ? tr("%1 (Connected)").arg(config->output()->name())
-            : config->output()->name();
+    updateCaption(indexOfOutput(config->output()));
+}
+
+void RandRConfig::updateCaption(int index)
+{
+    RandROutput *output = m_rowOutputs.at(index);
+    QString description = output->isConnected()
+            ? tr("%1 (Connected)").arg(output->name())
+            : output->name();
     m_outputList.at(index)->setCaption(description);
 }
 
+int RandRConfig::indexOfOutput(RandROutput *output) const
+{
+    return m_rowOutputs.indexOf(output);
+}
+
+OutputConfig *RandRConfig::configAt(int index) const
+{
+    // rows of outputs that were never connected only hold a placeholder
+    return qobject_cast<OutputConfig*>(m_outputList.at(index)->innerWidget());
+}
+
+void RandRConfig::addOutputRow(RandROutput *output)
+{
+    m_rowOutputs.append(output);
+
+    if (output->isConnected())
+    {
+        CollapsibleWidget *w = m_container->insertWidget(0, QString());
+        m_outputList.append(w);
+        buildOutputConfig(m_outputList.count() - 1);
+        w->setExpanded(true);
+        qDebug() << "Output rect:" << output->rect();
+    }
+    else
+    {
+        // the full panel is built once the row is expanded or the output
+        // gets connected
+        CollapsibleWidget *w = m_container->insertWidget(new QLabel(tr("Not connected")), QString());
+        m_outputList.append(w);
+        connect(w, SIGNAL(expandedChanged(bool)), this, SLOT(outputRowExpanded(bool)));
+        connect(output, SIGNAL(outputChanged(RROutput,int)),
+                this,   SLOT(placeholderOutputChanged(RROutput,int)));
+    }
+    updateCaption(m_outputList.count() - 1);
+}
+
+OutputConfig *RandRConfig::buildOutputConfig(int index)
+{
+    RandROutput *output = m_rowOutputs.at(index);
+    CollapsibleWidget *w = m_outputList.at(index);
+    QObject::disconnect(w, SIGNAL(expandedChanged(bool)), this, SLOT(outputRowExpanded(bool)));
+    QObject::disconnect(output, SIGNAL(outputChanged(RROutput,int)),
+                        this,   SLOT(placeholderOutputChanged(RROutput,int)));
+
+    // relative positions may only refer to the configs shown before it
+    OutputConfigList preceding;
+    for (int i = 0; i < index; ++i)
+    {
+        if (OutputConfig *config = configAt(i))
+            preceding.append(config);
+    }
+
+    OutputConfig *config = new OutputConfig(this, output, preceding, unifyOutputs->isChecked(),
+                                            m_positionResolver);
+    if (config->layout()) {
+        config->layout()->setMargin(2);
+        config->layout()->setSpacing(2);
+    }
+    delete w->innerWidget();
+    w->setInnerWidget(config);
+
+    m_configs.insert(preceding.count(), config);
+    m_positionResolver->addConfig( config );
+    connect(config, SIGNAL(connectedChanged(bool)), this, SLOT(outputConnectedChanged(bool)));
+
+    OutputGraphicsItem *o = new OutputGraphicsItem(config);
+    m_scene->addItem(o);
+    m_itemRegistry.insert(o, config, output->id(), output->name());
+
+    connect(o,    SIGNAL(itemChanged(OutputGraphicsItem*)),
+            this, SLOT(slotAdjustOutput(OutputGraphicsItem*)));
+
+    connect(config, SIGNAL(updateView()), this, SLOT(slotUpdateView()));
+    connect(config, SIGNAL(optionChanged()), this, SIGNAL(changed()));
+    return config;
+}
+
+void RandRConfig::removeVanishedRows()
+{
+    QList<RandROutput*> current = m_display->currentScreen()->outputs().values();
+    for (int i = m_rowOutputs.count() - 1; i >= 0; --i)
+    {
+        if (!current.contains(m_rowOutputs.at(i)))
+            removeOutputRow(i);
+    }
+}
+
+void RandRConfig::slotOutputsReclaimed()
+{
+    // called before the stale outputs are deleted; their widgets and items
+    // must be gone by then
+    removeVanishedRows();
+    slotUpdateView();
+}
+
+void RandRConfig::slotConfigChanged()
+{
+    // only a different set of outputs needs the widgets reconciled, the
+    // rest is picked up by the configs themselves
+    QList<RandROutput*> current = m_display->currentScreen()->outputs().values();
+    bool same = current.count() == m_rowOutputs.count();
+    foreach(RandROutput *output, current)
+    {
+        if (!same)
+            break;
+        same = m_rowOutputs.contains(output);
+    }
+    if (!same)
+        load();
+}
+
+void RandRConfig::removeOutputRow(int index)
+{
+    qDebug() << "Removing the widgets of a vanished output";
+    m_rowOutputs.removeAt(index);
+
+    OutputConfig *config = configAt(index);
+    if (config)
+    {
+        m_configs.removeAll(config);
+        m_positionResolver->removeConfig(config);
+        foreach(OutputConfig *other, m_configs)
+            other->removePreceding(config);
+
+        OutputGraphicsItem *o = m_itemRegistry.item(config);
+        m_itemRegistry.remove(o);
+        m_scene->removeItem(o);
+        delete o;
+    }
+
+    // the collapsible widget owns the config or placeholder
+    delete m_outputList.takeAt(index);
+}
+
+void RandRConfig::outputRowExpanded(bool expanded)
+{
+    int index = m_outputList.indexOf(static_cast<CollapsibleWidget*>(sender()));
+    if (!expanded || index == -1 || configAt(index))
+        return;
+
+    buildOutputConfig(index);
+    m_outputList.at(index)->setExpanded(true);
+    slotUpdateView();
+}
+
+void RandRConfig::placeholderOutputChanged(RROutput, int changes)
+{
+    int index = indexOfOutput(static_cast<RandROutput*>(sender()));
+    if (index == -1 || !(changes & RandR::ChangeConnection))
+        return;
+
+    updateCaption(index);
+    if (!m_rowOutputs.at(index)->isConnected() || configAt(index))
+        return;
+
+    buildOutputConfig(index);
+    m_outputList.at(index)->setExpanded(true);
+    slotUpdateView();
+}
+
 void RandRConfig::save()
 {
     if (!m_display->isValid())
         return;
 
-    QSettings config;
-    config.beginGroup("Screen_0");
-    config.setValue("OutputsUnified", unifyOutputs->isChecked());
-    config.endGroup();
+    RandRScreen *screen = m_display->currentScreen();
+    RandRConfigStore store;
+    store.open();
+    screen->selectProfile(store);
+    RandRConfigStore::ScreenRecord record = store.screen(screen->index());
+    record.flags = unifyOutputs->isChecked() ? RandRConfigStore::OutputsUnified : 0;
+    store.setScreen(record);
+    store.write();
 
     apply();
 }
@@ -215,9 +421,8 @@ void RandRConfig::apply()
     // normalize positions so that the coordinate system starts at (0,0)
     QPoint normalizePos;
     bool first = true;
-    foreach(CollapsibleWidget *w, m_outputList)
+    foreach(OutputConfig *config, m_configs)
     {
-        OutputConfig *config = static_cast<OutputConfig *>(w->innerWidget());
         if( config->isActive())
         {
             QPoint pos = config->position();
@@ -237,9 +442,8 @@ void RandRConfig::apply()
     normalizePos = -normalizePos;
     qDebug() << "Normalizing positions by" << normalizePos;
 
-    foreach(CollapsibleWidget *w, m_outputList)
+    foreach(OutputConfig *config, m_configs)
     {
-        OutputConfig *config = static_cast<OutputConfig *>(w->innerWidget());
         RandROutput *output = config->output();
 
         if(!output->isConnected())
@@ -262,12 +466,8 @@ void RandRConfig::apply()
                      << ", rate =" << config->refreshRate()
                      << ", brightness " << config->brightness();
 
-            // Break the connection with the previous CRTC for changed outputs, since
-            // otherwise the code could try to use the same CRTC for two different outputs.
-            // This is probably rather hackish and may not always work, but I don't see
-            // a better way with this codebase, definitely not with the time I have now.
-            output->disconnectFromCrtc();
-
+            // CRTCs are handed out for the whole layout in RandRScreen::applyProposed,
+            // so outputs keep their current CRTC here unless they really have to move.
             output->proposeRect(configuredRect.translated( normalizePos ));
             output->proposeRotation(config->rotation());
             output->proposeRefreshRate(config->refreshRate());
@@ -275,10 +475,13 @@ void RandRConfig::apply()
             output->proposeVirtualSize(config->virtualSize());
             output->proposeTracking(config->tracking());
             output->proposeVirtualModeEnabled(config->virtualModeEnabled());
+            output->proposeScale(QSizeF(1.0, 1.0));
         } else // user wants to disable this output
         {
+            // only proposed, so that the output can be brought back if the
+            // layout is reverted
             qDebug() << "Disabling" << output->name();
-            output->slotDisable();
+            output->proposeDisable();
         }
     }
 #ifdef HAS_RANDR_1_3
@@ -297,21 +500,14 @@ void RandRConfig::apply()
         }
     }
 #endif //HAS_RANDR_1_3
-    m_display->applyProposed();
+    if (!m_display->applyProposed())
+        showLayoutErrors();
     update();
 }
 
 void RandRConfig::updatePrimaryDisplay()
 {
-    QString primary=primaryDisplayBox->currentText();
-    foreach( QGraphicsItem* item, m_scene->items())
-    {
-        OutputGraphicsItem* itemo = dynamic_cast< OutputGraphicsItem* >( item );
-        if(itemo && (itemo->objectName()==primary)!=itemo->isPrimary())
-        {
-            itemo->setPrimary(itemo->objectName()==primary);
-        }
-    }
+    m_itemRegistry.setPrimary(primaryDisplayBox->currentText());
 }
 
 void RandRConfig::update()
@@ -348,13 +544,31 @@ void RandRConfig::slotAdjustOutput(OutputGraphicsItem *o)
     // TODO: Implement
 }
 
+void RandRConfig::slotProbed(int screen, ulong timestamp, ulong configTimestamp)
+{
+    // compare with what the probe saw: Xlib's copy of the timestamps only
+    // moves once the screen change event has been processed, which may
+    // well be after this
+    RandRScreen *current = m_display->currentScreen();
+    if (screen != current->index() || !current->needsRefresh(timestamp, configTimestamp))
+        return;
+
+    qDebug() << "Outputs of screen" << screen << "changed while probing, reloading";
+    current->invalidate();
+    current->loadSettings(true);
+    load();
+}
+
 void RandRConfig::slotUpdateView()
 {
-    compressUpdateViewTimer.start( 0 );
+    // rescale at most once per frame, however many widgets ask for it
+    if (!compressUpdateViewTimer.isActive())
+        compressUpdateViewTimer.start( 16 );
 }
 
 void RandRConfig::slotDelayedUpdateView()
 {
+    RandRBenchmark::Phase phase("RandRConfig::slotDelayedUpdateView");
     QRect r;
     bool first = true;
 
@@ -370,23 +584,66 @@ void RandRConfig::slotDelayedUpdateView()
             r = r.united(config->rect());
     }
     // scale the total bounding rectangle for all outputs to fit
-    // 80% of the containing QGraphicsView
-    float scaleX = (float)screenView->width() / r.width();
-    float scaleY = (float)screenView->height() / r.height();
-    float scale = (scaleX < scaleY) ? scaleX : scaleY;
-    scale *= 0.80f;
-
-    screenView->resetMatrix();
-    screenView->scale(scale,scale);
-    screenView->ensureVisible(r);
-    screenView->setSceneRect(r);
-
-    foreach( QGraphicsItem* item, m_scene->items()) {
-        if( OutputGraphicsItem* itemo = dynamic_cast< OutputGraphicsItem* >( item ))
-            itemo->configUpdated();
+    // 80% of the containing QGraphicsView; a new matrix invalidates the
+    // cached rendering of every item, so only do it when the fit changes
+    if (r != m_viewRect || screenView->size() != m_viewSize)
+    {
+        m_viewRect = r;
+        m_viewSize = screenView->size();
+
+        float scaleX = (float)screenView->width() / r.width();
+        float scaleY = (float)screenView->height() / r.height();
+        float scale = (scaleX < scaleY) ? scaleX : scaleY;
+        scale *= 0.80f;
+
+        screenView->resetMatrix();
+        screenView->scale(scale,scale);
+        screenView->ensureVisible(r);
+        screenView->setSceneRect(r);
     }
+
+    // the items repaint themselves when they actually change; the scene
+    // collects those into the dirty region of the view
+    foreach( OutputGraphicsItem* item, m_itemRegistry.items())
+        item->configUpdated();
     updatePrimaryDisplay();
-    screenView->update();
+    updateThumbnailRegions();
+    RandRBenchmark::viewUpdated();
+}
+
+void RandRConfig::updateThumbnailRegions()
+{
+    // the thumbnails show what is on the outputs now, so they follow the
+    // applied geometry rather than the one being edited
+    foreach(RandROutput *output, m_display->currentScreen()->outputs())
+    {
+        if (output->isActive())
+        {
+            m_thumbnailer->setRegion(output->id(), output->rect());
+            continue;
+        }
+
+        m_thumbnailer->removeRegion(output->id());
+        if (OutputGraphicsItem *item = m_itemRegistry.item(output->id()))
+            item->setThumbnail(QImage());
+    }
+}
+
+void RandRConfig::showThumbnailsChanged(bool checked)
+{
+    m_thumbnailer->setEnabled(checked);
+    if (checked)
+        return;
+
+    foreach(OutputGraphicsItem *item, m_itemRegistry.items())
+        item->setThumbnail(QImage());
+}
+
+void RandRConfig::thumbnailUpdated(ulong id, const QImage &thumbnail)
+{
+    OutputGraphicsItem *item = m_itemRegistry.item((RROutput)id);
+    if (item && m_thumbnailer->isEnabled())
+        item->setThumbnail(thumbnail);
 }
 
 uint qHash( const QPoint& p )
@@ -443,6 +700,19 @@ void RandRConfig::insufficientVirtualSize()
     message.show();
 }
 
+void RandRConfig::showLayoutErrors()
+{
+    // a layout that was not confirmed has no errors to show
+    LayoutErrorList errors = m_display->currentScreen()->layoutErrors();
+    if (errors.isEmpty())
+        return;
+
+    QStringList messages;
+    foreach(const RandRLayoutError &error, errors)
+        messages << error.message();
+    QMessageBox::warning(this, tr("Changing configuration failed"), messages.join("\n"));
+}
+
 bool RandRConfig::x11Event(XEvent* e)
 {
     return QWidget::x11Event(e);
@@ -26,6 +26,8 @@
 #include <QtGui/QWidget>
 #include <QtCore/QTimer>
 
+#include "outputitemregistry.h"
+
 class QGraphicsScene;
 class SettingsContainer;
 class CollapsibleWidget;
@@ -33,6 +35,9 @@ class RandRDisplay;
 class OutputGraphicsItem;
 class LayoutManager;
 class OutputConfig;
+class OutputPositionResolver;
+class RandROutput;
+class OutputThumbnailer;
 
 typedef QList<OutputConfig*> OutputConfigList;
 
@@ -50,6 +55,9 @@ public:
     void apply();
     void update();
 
+    /** Puts back the brightness of outputs that was only previewed. */
+    void cancelPreviews();
+
     virtual bool x11Event(XEvent* e);
 
 public slots:
@@ -59,10 +67,17 @@ public slots:
 
 protected slots:
     void slotAdjustOutput(OutputGraphicsItem *o);
+    void slotProbed(int screen, ulong timestamp, ulong configTimestamp);
+    void slotOutputsReclaimed();
+    void slotConfigChanged();
     void identifyOutputs();
     void clearIndicators();
     void unifiedOutputChanged(bool checked);
     void outputConnectedChanged(bool);
+    void outputRowExpanded(bool expanded);
+    void placeholderOutputChanged(RROutput output, int changes);
+    void showThumbnailsChanged(bool checked);
+    void thumbnailUpdated(ulong id, const QImage &thumbnail);
 
 signals:
     void changed(bool change=true);
@@ -72,17 +87,33 @@ protected:
 
 private:
         void insufficientVirtualSize();
+    void showLayoutErrors();
+    void updateCaption(int index);
+    int indexOfOutput(RandROutput *output) const;
+    OutputConfig *configAt(int index) const;
+    void addOutputRow(RandROutput *output);
+    OutputConfig *buildOutputConfig(int index);
+    void removeOutputRow(int index);
+    void removeVanishedRows();
+    void updateThumbnailRegions();
+
     RandRDisplay *m_display;
     bool m_firstLoad;
 
     SettingsContainer *m_container;
     QList<CollapsibleWidget*> m_outputList;
+    QList<RandROutput*> m_rowOutputs;       // output of each row
     QGraphicsScene *m_scene;
     LayoutManager *m_layoutManager;
     QList<QWidget*> m_indicators;
     QTimer identifyTimer;
     OutputConfigList m_configs;
+    OutputItemRegistry m_itemRegistry;
+    OutputPositionResolver *m_positionResolver;
+    OutputThumbnailer *m_thumbnailer;
     QTimer compressUpdateViewTimer;
+    QRect m_viewRect;       // scene rect and view size of the last rescale
+    QSize m_viewSize;
 };
 
 #endif
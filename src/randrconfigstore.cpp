@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+#include <QtCore/QDir>
+#include <QtCore/QFileInfo>
+#include <QtCore/QRegExp>
+#include <QtCore/QSettings>
+#include <QtCore/QStringList>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "randrconfigstore.h"
+#include "randr.h"
+
+// FNV-1a over the UTF-8 bytes: unlike qHash() it does not change between Qt
+// versions, and the fingerprints are kept in the file
+static quint32 fingerprintOf(const QString &key)
+{
+    QByteArray data = key.toUtf8();
+    quint32 hash = 2166136261u;
+    for (int i = 0; i < data.size(); ++i)
+    {
+        hash ^= (uchar) data.at(i);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+RandRConfigStore::RandRConfigStore(const QString &fileName)
+    : m_file(fileName),
+      m_map(0),
+      m_header(0),
+      m_profileRecords(0),
+      m_screenRecords(0),
+      m_outputRecords(0),
+      m_profile(0),
+      m_detached(false),
+      m_flags(0),
+      m_clock(0)
+{
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.screen = -1;
+}
+
+RandRConfigStore::~RandRConfigStore()
+{
+    close();
+}
+
+QString RandRConfigStore::defaultFileName()
+{
+    // same place QSettings puts the INI file, without having QSettings
+    // read it
+    QString dir = QFile::decodeName(qgetenv("XDG_CONFIG_HOME"));
+    if (dir.isEmpty())
+        dir = QDir::homePath() + "/.config";
+
+    QString organization = QCoreApplication::organizationName();
+    if (organization.isEmpty())
+        organization = QCoreApplication::organizationDomain();
+
+    return dir + '/' + organization + '/' + QCoreApplication::applicationName() + ".bin";
+}
+
+bool RandRConfigStore::open()
+{
+    close();
+    if (map())
+        return true;
+
+    if (m_file.exists())
+        qDebug() << "Config store" << m_file.fileName() << "is invalid or from another version";
+
+    QSettings config;
+    if (!migrate(config))
+        return false;
+
+    qDebug() << "Migrated the settings in" << config.fileName() << "to" << m_file.fileName();
+    return write();
+}
+
+void RandRConfigStore::close()
+{
+    if (m_map)
+        m_file.unmap(m_map);
+    m_file.close();
+
+    m_map = 0;
+    m_header = 0;
+    m_profileRecords = 0;
+    m_screenRecords = 0;
+    m_outputRecords = 0;
+    m_detached = false;
+    m_flags = 0;
+    m_clock = 0;
+    m_profiles.clear();
+    m_screens.clear();
+    m_outputs.clear();
+}
+
+bool RandRConfigStore::isOpen() const
+{
+    return m_header != 0;
+}
+
+bool RandRConfigStore::map()
+{
+    if (!m_file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = m_file.size();
+    if (size < (qint64) sizeof(Header))
+    {
+        m_file.close();
+        return false;
+    }
+
+    m_map = m_file.map(0, size);
+    if (!m_map)
+    {
+        m_file.close();
+        return false;
+    }
+
+    const Header *header = reinterpret_cast<const Header*>(m_map);
+    qint64 needed = (qint64) sizeof(Header)
+                  + (qint64) header->profileCount * sizeof(ProfileRecord)
+                  + (qint64) header->screenCount * sizeof(ScreenRecord)
+                  + (qint64) header->outputCount * sizeof(OutputRecord);
+    if (header->magic != Magic || header->version != Version
+        || header->headerSize != sizeof(Header) || size < needed)
+    {
+        close();
+        return false;
+    }
+
+    const ProfileRecord *profiles = reinterpret_cast<const ProfileRecord*>(m_map + sizeof(Header));
+    const ScreenRecord *screens = reinterpret_cast<const ScreenRecord*>(profiles + header->profileCount);
+    const OutputRecord *outputs = reinterpret_cast<const OutputRecord*>(screens + header->screenCount);
+
+    // names are compared with qstrcmp(), which must not run past a record
+    for (quint32 i = 0; i < header->outputCount; ++i)
+    {
+        if (!memchr(outputs[i].name, 0, NameLength))
+        {
+            close();
+            return false;
+        }
+    }
+
+    m_header = header;
+    m_profileRecords = profiles;
+    m_screenRecords = screens;
+    m_outputRecords = outputs;
+    return true;
+}
+
+void RandRConfigStore::detach()
+{
+    if (m_detached)
+        return;
+
+    m_flags = displayFlags();
+    m_clock = m_header ? m_header->clock : 0;
+    for (int i = 0; i < profileCount(); ++i)
+        m_profiles.append(*profileAt(i));
+    for (int i = 0; i < screenCount(); ++i)
+        m_screens.append(*screenAt(i));
+    for (int i = 0; i < outputCount(); ++i)
+        m_outputs.append(*outputAt(i));
+    m_detached = true;
+}
+
+int RandRConfigStore::profileCount() const
+{
+    if (m_detached)
+        return m_profiles.count();
+    return m_header ? m_header->profileCount : 0;
+}
+
+int RandRConfigStore::screenCount() const
+{
+    if (m_detached)
+        return m_screens.count();
+    return m_header ? m_header->screenCount : 0;
+}
+
+int RandRConfigStore::outputCount() const
+{
+    if (m_detached)
+        return m_outputs.count();
+    return m_header ? m_header->outputCount : 0;
+}
+
+const RandRConfigStore::ProfileRecord *RandRConfigStore::profileAt(int i) const
+{
+    return m_detached ? &m_profiles.at(i) : m_profileRecords + i;
+}
+
+const RandRConfigStore::ScreenRecord *RandRConfigStore::screenAt(int i) const
+{
+    return m_detached ? &m_screens.at(i) : m_screenRecords + i;
+}
+
+const RandRConfigStore::OutputRecord *RandRConfigStore::outputAt(int i) const
+{
+    return m_detached ? &m_outputs.at(i) : m_outputRecords + i;
+}
+
+bool RandRConfigStore::selectProfile(int screen, const QStringList &connectors,
+                                     const QStringList &serials)
+{
+    QStringList keys;
+    for (int i = 0; i < connectors.count(); ++i)
+        keys << connectors.at(i) + '\n' + serials.value(i);
+    keys.sort();
+
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.screen = screen;
+    m_current.outputCount = qMin(keys.count(), (int) MaxOutputs);
+    for (uint i = 0; i < m_current.outputCount; ++i)
+    {
+        m_current.outputs[i] = fingerprintOf(keys.at(i));
+        m_current.connectors[i] = fingerprintOf(keys.at(i).section('\n', 0, 0));
+    }
+
+    // 0 is the fingerprint of the unkeyed profile
+    m_current.fingerprint = fingerprintOf(QString::number(screen) + '\n' + keys.join("\n"));
+    if (!m_current.fingerprint)
+        m_current.fingerprint = 1;
+
+    if (findProfile(m_current.fingerprint) != -1)
+    {
+        m_profile = m_current.fingerprint;
+        return true;
+    }
+
+    int closest = closestProfile();
+    m_profile = (closest != -1) ? profileAt(closest)->fingerprint : m_current.fingerprint;
+    return false;
+}
+
+quint32 RandRConfigStore::profile() const
+{
+    return m_profile;
+}
+
+bool RandRConfigStore::touchProfile()
+{
+    int index = findProfile(m_profile);
+    if (index == -1)
+        return false;
+
+    // usually the profile is the most recently used one already
+    quint32 clock = m_detached ? m_clock : (m_header ? m_header->clock : 0);
+    if (profileAt(index)->lastUsed == clock)
+        return false;
+
+    detach();
+    m_profiles[index].lastUsed = ++m_clock;
+    return true;
+}
+
+int RandRConfigStore::findProfile(quint32 fingerprint) const
+{
+    if (!m_detached && m_header)
+    {
+        // open addressing with linear probing, see write()
+        for (uint i = 0; i < IndexSize; ++i)
+        {
+            const IndexSlot &slot = m_header->index[(fingerprint + i) % IndexSize];
+            if (!slot.profile)
+                return -1;
+            if (slot.fingerprint == fingerprint && slot.profile <= m_header->profileCount)
+                return slot.profile - 1;
+        }
+        return -1;
+    }
+
+    for (int i = 0; i < m_profiles.count(); ++i)
+    {
+        if (m_profiles.at(i).fingerprint == fingerprint)
+            return i;
+    }
+    return -1;
+}
+
+int RandRConfigStore::closestProfile() const
+{
+    // a monitor found again counts twice as much as a connector that is
+    // used by another monitor now; outputs the profile has and the current
+    // hardware lacks count against it
+    int best = -1;
+    int bestScore = 0;
+    for (int i = 0; i < profileCount(); ++i)
+    {
+        const ProfileRecord *profile = profileAt(i);
+        if (!profile->fingerprint || profile->screen != m_current.screen)
+            continue;
+
+        int score = 0;
+        int matched = 0;
+        for (uint j = 0; j < m_current.outputCount; ++j)
+        {
+            for (uint k = 0; k < profile->outputCount; ++k)
+            {
+                if (profile->outputs[k] == m_current.outputs[j])
+                {
+                    score += 2;
+                    ++matched;
+                    break;
+                }
+                if (profile->connectors[k] == m_current.connectors[j])
+                {
+                    score += 1;
+                    ++matched;
+                    break;
+                }
+            }
+        }
+        score -= (int) profile->outputCount - matched;
+
+        if (score > bestScore
+            || (best != -1 && score == bestScore && profile->lastUsed > profileAt(best)->lastUsed))
+        {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    if (best == -1)
+        best = findProfile(0);
+    return best;
+}
+
+void RandRConfigStore::useProfile()
+{
+    detach();
+
+    int index = findProfile(m_current.fingerprint);
+    if (index == -1)
+    {
+        if (m_profiles.count() >= MaxProfiles)
+        {
+            // drop the least recently used profile with all its records
+            int oldest = 0;
+            for (int i = 1; i < m_profiles.count(); ++i)
+            {
+                if (m_profiles.at(i).lastUsed < m_profiles.at(oldest).lastUsed)
+                    oldest = i;
+            }
+
+            quint32 fingerprint = m_profiles.at(oldest).fingerprint;
+            qDebug() << "Dropping the least recently used profile" << fingerprint;
+            m_profiles.remove(oldest);
+            for (int i = m_screens.count() - 1; i >= 0; --i)
+            {
+                if (m_screens.at(i).profile == fingerprint)
+                    m_screens.remove(i);
+            }
+            for (int i = m_outputs.count() - 1; i >= 0; --i)
+            {
+                if (m_outputs.at(i).profile == fingerprint)
+                    m_outputs.remove(i);
+            }
+        }
+
+        m_profiles.append(m_current);
+        index = m_profiles.count() - 1;
+    }
+
+    m_profiles[index].lastUsed = ++m_clock;
+}
+
+quint32 RandRConfigStore::displayFlags() const
+{
+    if (m_detached)
+        return m_flags;
+    return m_header ? m_header->flags : 0;
+}
+
+void RandRConfigStore::setDisplayFlags(quint32 flags)
+{
+    detach();
+    m_flags = flags;
+}
+
+RandRConfigStore::ScreenRecord RandRConfigStore::screen(int index) const
+{
+    // records already written to the profile of the current hardware win
+    // over the ones of the profile it was read from
+    quint32 profiles[2] = { m_current.fingerprint, m_profile };
+    for (int p = 0; p < 2; ++p)
+    {
+        for (int i = 0; i < screenCount(); ++i)
+        {
+            const ScreenRecord *record = screenAt(i);
+            if (record->profile == profiles[p] && record->index == index)
+            {
+                ScreenRecord result = *record;
+                result.profile = m_current.fingerprint;
+                return result;
+            }
+        }
+    }
+
+    ScreenRecord record;
+    memset(&record, 0, sizeof(record));
+    record.profile = m_current.fingerprint;
+    record.index = index;
+    record.unifiedRotation = RandR::Rotate0;
+    return record;
+}
+
+RandRConfigStore::OutputRecord RandRConfigStore::output(int screen, const QString &name) const
+{
+    char key[NameLength];
+    qstrncpy(key, name.toUtf8().constData(), NameLength);
+
+    quint32 profiles[2] = { m_current.fingerprint, m_profile };
+    for (int p = 0; p < 2; ++p)
+    {
+        for (int i = 0; i < outputCount(); ++i)
+        {
+            const OutputRecord *record = outputAt(i);
+            if (record->profile == profiles[p] && record->screen == screen
+                && qstrcmp(record->name, key) == 0)
+            {
+                OutputRecord result = *record;
+                result.profile = m_current.fingerprint;
+                return result;
+            }
+        }
+    }
+
+    OutputRecord record;
+    memset(&record, 0, sizeof(record));
+    record.profile = m_current.fingerprint;
+    record.screen = screen;
+    record.flags = Active;
+    qstrcpy(record.name, key);
+    record.rotation = RandR::Rotate0;
+    return record;
+}
+
+void RandRConfigStore::setScreen(const ScreenRecord &record)
+{
+    useProfile();
+    ScreenRecord stamped = record;
+    stamped.profile = m_current.fingerprint;
+    for (int i = 0; i < m_screens.count(); ++i)
+    {
+        if (m_screens.at(i).profile == stamped.profile && m_screens.at(i).index == stamped.index)
+        {
+            m_screens[i] = stamped;
+            return;
+        }
+    }
+    m_screens.append(stamped);
+}
+
+void RandRConfigStore::setOutput(const OutputRecord &record)
+{
+    useProfile();
+    OutputRecord stamped = record;
+    stamped.profile = m_current.fingerprint;
+    for (int i = 0; i < m_outputs.count(); ++i)
+    {
+        const OutputRecord &current = m_outputs.at(i);
+        if (current.profile == stamped.profile && current.screen == stamped.screen
+            && qstrcmp(current.name, stamped.name) == 0)
+        {
+            m_outputs[i] = stamped;
+            return;
+        }
+    }
+    m_outputs.append(stamped);
+}
+
+bool RandRConfigStore::write()
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = Magic;
+    header.version = Version;
+    header.headerSize = sizeof(Header);
+    header.flags = displayFlags();
+    header.clock = m_detached ? m_clock : (m_header ? m_header->clock : 0);
+    header.profileCount = profileCount();
+    header.screenCount = screenCount();
+    header.outputCount = outputCount();
+
+    // there are never more profiles than half the slots, so the probing
+    // in findProfile() ends after a few steps
+    for (int i = 0; i < profileCount(); ++i)
+    {
+        quint32 fingerprint = profileAt(i)->fingerprint;
+        for (uint j = 0; j < IndexSize; ++j)
+        {
+            IndexSlot &slot = header.index[(fingerprint + j) % IndexSize];
+            if (!slot.profile)
+            {
+                slot.fingerprint = fingerprint;
+                slot.profile = i + 1;
+                break;
+            }
+        }
+    }
+
+    QByteArray data;
+    data.reserve(sizeof(Header) + header.profileCount * sizeof(ProfileRecord)
+                 + header.screenCount * sizeof(ScreenRecord)
+                 + header.outputCount * sizeof(OutputRecord));
+    data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (int i = 0; i < profileCount(); ++i)
+        data.append(reinterpret_cast<const char*>(profileAt(i)), sizeof(ProfileRecord));
+    for (int i = 0; i < screenCount(); ++i)
+        data.append(reinterpret_cast<const char*>(screenAt(i)), sizeof(ScreenRecord));
+    for (int i = 0; i < outputCount(); ++i)
+        data.append(reinterpret_cast<const char*>(outputAt(i)), sizeof(OutputRecord));
+
+    QString path = m_file.fileName();
+    QString temp = path + ".tmp";
+    QDir().mkpath(QFileInfo(path).path());
+
+    QFile file(temp);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+        || file.write(data) != data.size() || !file.flush()
+        || ::fsync(file.handle()) != 0)
+    {
+        file.close();
+        QFile::remove(temp);
+        return false;
+    }
+    file.close();
+
+    // the data is on disk before rename() replaces the old file in one
+    // step, so a crash leaves either file whole; the old mapping stays
+    // valid until it is closed
+    if (::rename(QFile::encodeName(temp).constData(), QFile::encodeName(path).constData()) != 0)
+    {
+        QFile::remove(temp);
+        return false;
+    }
+
+    close();
+    return map();
+}
+
+QRect RandRConfigStore::rect(const qint32 *r)
+{
+    return QRect(r[0], r[1], r[2], r[3]);
+}
+
+void RandRConfigStore::setRect(qint32 *r, const QRect &rect)
+{
+    r[0] = rect.x();
+    r[1] = rect.y();
+    r[2] = rect.width();
+    r[3] = rect.height();
+}
+
+static QRect iniRect(QSettings &config, const QString &key)
+{
+    // "0,0,0,0" (serialization for QRect()) does not convert to a QRect
+    QVariant value = config.value(key, "0,0,0,0");
+    return value == QVariant("0,0,0,0") ? QRect() : value.toRect();
+}
+
+bool RandRConfigStore::migrate(QSettings &config)
+{
+    QRegExp screenGroup("Screen_(\\d+)");
+    QRegExp outputGroup("Screen_(\\d+)_Output_(.+)");
+    bool found = false;
+
+    close();
+    detach();
+
+    // the old settings were not tied to any hardware
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.screen = -1;
+    m_profile = 0;
+
+    foreach(const QString &group, config.childGroups())
+    {
+        config.beginGroup(group);
+        if (group == "Display")
+        {
+            if (config.value("ApplyOnStartup", false).toBool())
+                m_flags |= ApplyOnStartup;
+            if (config.value("SyncTrayApp", false).toBool())
+                m_flags |= SyncTrayApp;
+            found = true;
+        }
+        else if (outputGroup.exactMatch(group))
+        {
+            OutputRecord record = output(outputGroup.cap(1).toInt(), outputGroup.cap(2));
+            record.flags = 0;
+            if (config.value("Active", true).toBool())
+                record.flags |= Active;
+            if (config.value("Tracking", false).toBool())
+                record.flags |= Tracking;
+            if (config.value("VirtualModeEnabled", false).toBool())
+                record.flags |= VirtualModeEnabled;
+            setRect(record.rect, iniRect(config, "Rect"));
+            record.rotation = config.value("Rotation", (int) RandR::Rotate0).toInt();
+            record.refreshRate = config.value("RefreshRate", 0).toFloat();
+            record.brightness = config.value("Brightness", 0).toFloat();
+            setRect(record.virtualRect, iniRect(config, "VirtualRect"));
+            setOutput(record);
+            found = true;
+        }
+        else if (screenGroup.exactMatch(group))
+        {
+            ScreenRecord record = screen(screenGroup.cap(1).toInt());
+            record.flags = config.value("OutputsUnified", false).toBool() ? OutputsUnified : 0;
+            setRect(record.unifiedRect, iniRect(config, "UnifiedRect"));
+            record.unifiedRotation = config.value("UnifiedRotation", (int) RandR::Rotate0).toInt();
+            setScreen(record);
+            found = true;
+        }
+        config.endGroup();
+    }
+
+    return found;
+}
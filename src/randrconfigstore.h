@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRCONFIGSTORE_H
+#define RANDRCONFIGSTORE_H
+
+#include <QtCore/QFile>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+#include <QtCore/QVector>
+
+class QSettings;
+
+/** Binary store for the screen and output settings.
+ *
+ * The file is a fixed header followed by one record per screen and one per
+ * output. The records have a fixed size and layout, so the file is mapped
+ * into memory and read in place, without parsing or QVariant conversions.
+ * Changes are made on a copy of the records and written with write(),
+ * which replaces the file through a temporary file.
+ *
+ * The records are grouped in profiles, one per set of connected monitors
+ * of a screen. A profile is keyed by a fingerprint of the connector names
+ * and EDID serials of the connected outputs, so the same connectors with
+ * different monitors get their own layout. selectProfile() finds the
+ * profile of the current hardware through a small hash table in the header
+ * in constant time; if there is none, the profile sharing most monitors
+ * and connectors is read instead. Changes always go into the profile of the
+ * current hardware, and when there are more than MaxProfiles the least
+ * recently used one is dropped.
+ *
+ * When the file does not exist yet, open() migrates the Screen_N and
+ * Screen_N_Output_NAME groups of the old INI settings once, into the
+ * unkeyed profile 0 that is used when no other profile matches. The INI
+ * file is not read again afterwards and the store never writes to it. */
+class RandRConfigStore
+{
+public:
+    enum {
+        Magic = 0x52524c58,     // "XLRR" in little endian
+        Version = 2,
+        NameLength = 32,
+        MaxProfiles = 8,
+        MaxOutputs = 8,         // outputs taken into account per profile
+        IndexSize = 16          // slots of the profile hash table
+    };
+
+    enum DisplayFlag {
+        ApplyOnStartup = 0x1,
+        SyncTrayApp = 0x2
+    };
+
+    enum ScreenFlag {
+        OutputsUnified = 0x1
+    };
+
+    enum OutputFlag {
+        Active = 0x1,
+        Tracking = 0x2,
+        VirtualModeEnabled = 0x4
+    };
+
+    struct IndexSlot
+    {
+        quint32 fingerprint;
+        quint32 profile;        // index of the profile + 1, 0 if empty
+    };
+
+    struct Header
+    {
+        quint32 magic;
+        quint16 version;
+        quint16 headerSize;
+        quint32 flags;          // DisplayFlag
+        quint32 clock;          // last ProfileRecord::lastUsed handed out
+        quint32 profileCount;
+        quint32 screenCount;
+        quint32 outputCount;
+        IndexSlot index[IndexSize];
+    };
+
+    struct ProfileRecord
+    {
+        quint32 fingerprint;
+        quint32 lastUsed;
+        qint32 screen;
+        quint32 outputCount;
+        quint32 outputs[MaxOutputs];      // hashes of connector and serial
+        quint32 connectors[MaxOutputs];   // hashes of the connector alone
+    };
+
+    struct ScreenRecord
+    {
+        quint32 profile;
+        qint32 index;
+        quint32 flags;          // ScreenFlag
+        qint32 unifiedRect[4];  // x, y, width, height; empty for QRect()
+        qint32 unifiedRotation;
+    };
+
+    struct OutputRecord
+    {
+        quint32 profile;
+        qint32 screen;
+        quint32 flags;          // OutputFlag
+        char name[NameLength];  // nul terminated
+        qint32 rect[4];
+        qint32 rotation;
+        float refreshRate;
+        float brightness;
+        qint32 virtualRect[4];
+    };
+
+    RandRConfigStore(const QString &fileName = defaultFileName());
+    ~RandRConfigStore();
+
+    /** The store next to the INI settings of the application. */
+    static QString defaultFileName();
+
+    /** Maps the file, migrating the INI settings first if there is no file
+     * yet. Returns false if there is nothing to read; the accessors return
+     * the defaults then. */
+    bool open();
+    void close();
+    bool isOpen() const;
+
+    /** Selects the profile for the given connected outputs of a screen.
+     * @p serials holds the EDID serial of each connector, empty if unknown.
+     * Returns true if there is a profile for exactly this hardware. */
+    bool selectProfile(int screen, const QStringList &connectors, const QStringList &serials);
+
+    /** Fingerprint of the profile records are read from. */
+    quint32 profile() const;
+
+    /** Marks the profile records are read from as the most recently used
+     * one. Returns true if that changed the store, which then needs a
+     * write(). */
+    bool touchProfile();
+
+    quint32 displayFlags() const;
+    void setDisplayFlags(quint32 flags);
+
+    /** The record of a screen or output, or one holding the defaults if
+     * nothing was stored for it. */
+    ScreenRecord screen(int index) const;
+    OutputRecord output(int screen, const QString &name) const;
+
+    void setScreen(const ScreenRecord &record);
+    void setOutput(const OutputRecord &record);
+
+    bool write();
+
+    static QRect rect(const qint32 *r);
+    static void setRect(qint32 *r, const QRect &rect);
+
+private:
+    Q_DISABLE_COPY(RandRConfigStore)
+
+    bool map();
+    bool migrate(QSettings &config);
+    void detach();
+
+    int findProfile(quint32 fingerprint) const;
+    int closestProfile() const;
+    void useProfile();
+
+    int profileCount() const;
+    int screenCount() const;
+    int outputCount() const;
+    const ProfileRecord *profileAt(int i) const;
+    const ScreenRecord *screenAt(int i) const;
+    const OutputRecord *outputAt(int i) const;
+
+    QFile m_file;
+    uchar *m_map;
+    const Header *m_header;
+    const ProfileRecord *m_profileRecords;
+    const ScreenRecord *m_screenRecords;
+    const OutputRecord *m_outputRecords;
+
+    // the hardware of the selected screen and the profile read for it
+    ProfileRecord m_current;
+    quint32 m_profile;
+
+    // copies of the records once something is changed
+    bool m_detached;
+    quint32 m_flags;
+    quint32 m_clock;
+    QVector<ProfileRecord> m_profiles;
+    QVector<ScreenRecord> m_screens;
+    QVector<OutputRecord> m_outputs;
+};
+
+#endif // RANDRCONFIGSTORE_H
@@ -22,11 +22,12 @@
 #include "randroutput.h"
 #include "randrmode.h"
 #include "randrgammainfo.h"
-#include <unistd.h> // for sleep()
+#include "randrworker.h"
 
 RandRCrtc::RandRCrtc(RandRScreen *parent, RRCrtc id)
     : QObject(parent),
       m_currentRect(0, 0, 0, 0),
+      m_currentArea(m_currentRect),
       m_originalRect(m_currentRect),
       m_proposedRect(m_originalRect),
       m_proposedBrightness(1.0),
@@ -41,19 +42,18 @@ RandRCrtc::RandRCrtc(RandRScreen *parent, RRCrtc id)
     m_currentRate = m_originalRate = m_proposedRate = 0;
     m_currentMode = 0;
     m_originalBrightness = 1.0;
+    m_previewedBrightness = -1;
     m_rotations = RandR::Rotate0;
     m_currentTracking = m_originalTracking = m_proposedTracking = true;
     m_currentVirtualModeEnabled = m_originalVirtualModeEnabled = m_proposedVirtualModeEnabled = false;
-    memset (&m_transform, '\0', sizeof (m_transform));
-    m_filter = new char[9];
-    sprintf(m_filter, "bilinear");
+    m_transformPending = false;
 
     m_id = id;
+    m_generation = 0;
 }
 
 RandRCrtc::~RandRCrtc()
 {
-    delete m_filter;
 }
 
 RRCrtc RandRCrtc::id() const
@@ -91,6 +91,16 @@ bool RandRCrtc::virtualModeEnabled() const
     return m_currentVirtualModeEnabled;
 }
 
+uint RandRCrtc::generation() const
+{
+    return m_generation;
+}
+
+void RandRCrtc::setGeneration(uint generation)
+{
+    m_generation = generation;
+}
+
 bool RandRCrtc::isValid(void) const
 {
     return m_id != None;
@@ -110,38 +120,66 @@ void RandRCrtc::loadSettings(bool notify)
     if (RandR::timestamp != info->timestamp)
         RandR::timestamp = info->timestamp;
 
+    // the server gives the area with the transform applied
     QRect rect = QRect(info->x, info->y, info->width, info->height);
-    if (rect != m_currentRect)
+    if (rect != m_currentArea)
     {
-        m_currentRect = rect;
+        m_currentArea = rect;
         changes |= RandR::ChangeRect;
     }
     
     // Get panning
-    XRRPanning  *panning_info = XRRGetPanning(QX11Info::display(), m_screen->resources(), m_id);
-    rect = QRect(panning_info->left, panning_info->top, panning_info->width, panning_info->height);
-    if(rect != m_currentVirtualRect)
+    if (m_screen->capabilities().panning)
     {
-        m_currentVirtualRect = rect;
-        changes |= RandR::ChangeVirtualRect;
-    }
-    if( rect.width() != info->width || rect.height() != info->height )
-    {
-        m_currentTracking = true;
-        changes |= RandR::ChangeVirtualRect;
+        XRRPanning  *panning_info = XRRGetPanning(QX11Info::display(), m_screen->resources(), m_id);
+        rect = QRect(panning_info->left, panning_info->top, panning_info->width, panning_info->height);
+        if(rect != m_currentVirtualRect)
+        {
+            m_currentVirtualRect = rect;
+            changes |= RandR::ChangeVirtualRect;
+        }
+        if( rect.width() != info->width || rect.height() != info->height )
+        {
+            m_currentTracking = true;
+            changes |= RandR::ChangeVirtualRect;
+        }
+        else
+           m_currentTracking = false;
+        XRRFreePanning(panning_info);
     }
-    else
-       m_currentTracking = false;
-    XRRFreePanning(panning_info);
     
     // Get red, blue, green and brightness
-    float _brightness;
-    get_gamma_info(QX11Info::display(), m_screen->resources(), m_id, &_brightness, &red, &blue, &green);
-    
-    if(_brightness != m_currentBrightness)
+    if (m_screen->capabilities().gamma)
     {
-        m_currentBrightness = _brightness;
-        changes |= RandR::ChangeBrightness;
+        float _brightness;
+        get_gamma_info(QX11Info::display(), m_screen->resources(), m_id, &_brightness, &red, &blue, &green);
+
+        // a preview is not the current brightness until it is applied
+        if(_brightness != m_currentBrightness && m_previewedBrightness < 0)
+        {
+            m_currentBrightness = _brightness;
+            changes |= RandR::ChangeBrightness;
+        }
+    }
+
+    // Get the current transform
+    if (m_screen->capabilities().transform)
+    {
+        RandRTransform transform;
+        XRRCrtcTransformAttributes *attr;
+        if (XRRGetCrtcTransform(QX11Info::display(), m_id, &attr) && attr)
+        {
+            transform = RandRTransform::fromX(attr->currentTransform, attr->currentFilter,
+                                              attr->currentParams, attr->currentNparams);
+            XFree(attr);
+        }
+        if (transform != m_currentTransform)
+        {
+            m_currentTransform = transform;
+            // a set-config took whatever transform was uploaded
+            m_transformPending = false;
+            changes |= RandR::ChangeTransform;
+        }
     }
 
     // get all connected outputs
@@ -186,6 +224,18 @@ void RandRCrtc::loadSettings(bool notify)
     }
 
     RandRMode m = m_screen->mode(m_currentMode);
+
+    // proposals are made in mode space, so keep the untransformed rect of a
+    // transformed CRTC too
+    rect = m_currentArea;
+    if (!m_currentTransform.isIdentity() && m.isValid())
+        rect.setSize(m.size());
+    if (rect != m_currentRect)
+    {
+        m_currentRect = rect;
+        changes |= RandR::ChangeRect;
+    }
+
     if (m_currentRate != m.refreshRate())
     {
         m_currentRate = m.refreshRate();
@@ -257,6 +307,7 @@ void RandRCrtc::handleEvent(XRRCrtcChangeNotifyEvent *event)
         qDebug() << "   Changed position: " << event->x << "," << event->y;
         changed |= RandR::ChangeRect;
         m_currentRect.moveTopLeft(QPoint(event->x, event->y));
+        m_currentArea.moveTopLeft(QPoint(event->x, event->y));
     }
 
     RandRMode mode = m_screen->mode(m_currentMode);
@@ -266,6 +317,14 @@ void RandRCrtc::handleEvent(XRRCrtcChangeNotifyEvent *event)
         changed |= RandR::ChangeRect;
         m_currentRect.setSize(mode.size());
         //Do NOT use event->width and event->height here, as it is being returned wrongly
+        m_currentArea = m_currentRect;
+        if (!m_currentTransform.isIdentity())
+        {
+            QSize area = m_currentTransform.mapSize(mode.size());
+            if (m_currentRotation & (RandR::Rotate90 | RandR::Rotate270))
+                area.transpose();
+            m_currentArea.setSize(area);
+        }
     }
 
     if (changed)
@@ -278,6 +337,11 @@ RandRMode RandRCrtc::mode() const
 }
 
 QRect RandRCrtc::rect() const
+{
+    return m_currentArea;
+}
+
+QRect RandRCrtc::modeRect() const
 {
     return m_currentRect;
 }
@@ -287,6 +351,11 @@ float RandRCrtc::refreshRate() const
     return m_currentRate;
 }
 
+RandRTransform RandRCrtc::transform() const
+{
+    return m_currentTransform;
+}
+
 bool RandRCrtc::applyProposed()
 {
     qDebug() << "Applying proposed changes for CRTC" << m_id << "...";
@@ -303,8 +372,23 @@ bool RandRCrtc::applyProposed()
     for (int i = 0; i < m_connectedOutputs.count(); ++i)
         qDebug() << "          -" << m_screen->output(m_connectedOutputs.at(i))->name();
 
+    // the transform the CRTC ends up with: a virtual size without tracking
+    // is scaled onto the mode
+    RandRTransform transform = m_proposedTransform;
+    if (m_proposedVirtualModeEnabled && !m_proposedTracking && !m_proposedRect.isEmpty())
+    {
+        transform = RandRTransform::scale(
+            (qreal)m_proposedVirtualRect.width() / m_proposedRect.width(),
+            (qreal)m_proposedVirtualRect.height() / m_proposedRect.height());
+        transform.setFilter(m_proposedTransform.filter());
+    }
+    transform = transform.normalized(m_proposedRect.size());
+
+    // the framebuffer area the CRTC covers once the transform is applied
+    QRect area(m_proposedRect.topLeft(), transform.mapSize(m_proposedRect.size()));
+
     RandRMode mode;
-    if (m_proposedRect.size() == m_currentRect.size() && m_proposedRate == m_currentRate)
+    if (m_proposedRect.size() == m_screen->mode(m_currentMode).size() && m_proposedRate == m_currentRate)
     {
         mode = m_screen->mode(m_currentMode);
     }
@@ -356,7 +440,7 @@ bool RandRCrtc::applyProposed()
             (m_currentRotation == RandR::Rotate90 && m_proposedRotation == RandR::Rotate270) ||
             (m_currentRotation == RandR::Rotate270 && m_proposedRotation == RandR::Rotate90))
         {
-            QRect r = QRect(0,0,0,0).united(m_proposedRect);
+            QRect r = QRect(0,0,0,0).united(area);
             if (r.width() > m_screen->maxSize().width() || r.height() > m_screen->maxSize().height())
                 return false;
 
@@ -373,7 +457,7 @@ bool RandRCrtc::applyProposed()
         else
         {
 
-            QRect r(m_proposedRect.topLeft(), QSize(m_proposedRect.height(), m_proposedRect.width()));
+            QRect r(m_proposedRect.topLeft(), transform.mapSize(QSize(m_proposedRect.height(), m_proposedRect.width())));
             if (!m_screen->rect().contains(r))
             {
                 // check if the rotated rect is smaller than the max screen size
@@ -382,7 +466,7 @@ bool RandRCrtc::applyProposed()
                     return false;
 
                 // adjust the screen size
-                r = r.united(m_currentRect);
+                r = r.united(m_currentArea);
                 if (!m_screen->adjustSize(r))
                     return false;
             }
@@ -406,32 +490,18 @@ bool RandRCrtc::applyProposed()
         }
     }
 
-    { // Set scale
-        int major, minor; // Chack XRandr version. Xrandr 1.3 needed.
-        XRRQueryVersion (QX11Info::display(), &major, &minor);
-        if (major > 1 || (major == 1 && minor >= 3))
-        {
-            int nparams = 0;
-            XFixed *params = NULL;
-            memset (&m_transform, '\0', sizeof (m_transform));
-            float width;
-            float height;
-            if(m_proposedTracking || !m_proposedVirtualModeEnabled)
-                width = height = 1.0;
-            else
-            {
-                width = (float)m_proposedVirtualRect.size().width() / (float)m_proposedRect.size().width();
-                height = (float)m_proposedVirtualRect.size().height() / (float)m_proposedRect.size().height();
-            }
-            m_transform.matrix[0][0] = XDoubleToFixed (width);
-            m_transform.matrix[1][1] = XDoubleToFixed (height);
-            m_transform.matrix[2][2] = XDoubleToFixed (1.0);
-            XRRSetCrtcTransform (QX11Info::display(), m_id, &m_transform, m_filter, params, nparams);
-            qDebug() << "[RandRCrtc::applyProposed] scale width" << width << "height=" << height;
-        }
+    // Set the transform. It only takes effect with the next set-config, so it
+    // is sent again if that failed
+    if (m_screen->capabilities().transform && (transform != m_currentTransform || m_transformPending))
+    {
+        XTransform fixed = transform.fixed();
+        QByteArray filter = transform.filterName();
+        XRRSetCrtcTransform(QX11Info::display(), m_id, &fixed, filter.data(),
+                            transform.params(), transform.paramCount());
+        m_transformPending = true;
+        qDebug() << "[RandRCrtc::applyProposed] transform uploaded, filter" << filter;
     }
 
-
     RROutput *outputs = new RROutput[m_connectedOutputs.count()];
     for (int i = 0; i < m_connectedOutputs.count(); ++i)
         outputs[i] = m_connectedOutputs.at(i);
@@ -444,7 +514,7 @@ bool RandRCrtc::applyProposed()
     delete[] outputs;
 
     // Set panning
-    if(m_proposedVirtualModeEnabled)
+    if(m_proposedVirtualModeEnabled && m_screen->capabilities().panning)
     {
         /////////////////////////////////////
         XRRPanning *panning = XRRGetPanning  (QX11Info::display(),m_screen->resources(), m_id);
@@ -467,16 +537,16 @@ bool RandRCrtc::applyProposed()
     }
     
     // Set gamma
-    //Gamma is applied twice
     qDebug() << "[RandRCrtc::applyProposed] m_proposedBrightness" << m_proposedBrightness;
-    // Wait for set gamma. Wait for Xrandr setting brightness when virtual size is changed
-    sleep(3);
-    //XFlush(QX11Info::display());
-    //XSync(QX11Info::display(), False);
-    //Gamma is applied twice
-    set_gamma(QX11Info::display(), m_screen->resources(), m_id, m_proposedBrightness, red, blue, green);
-    set_gamma(QX11Info::display(), m_screen->resources(), m_id, m_proposedBrightness, red, blue, green);
-    m_currentBrightness = m_proposedBrightness;
+    // Wait for Xrandr setting brightness when virtual size is changed. The
+    // worker waits, so the GUI keeps running meanwhile
+    if (m_screen->capabilities().gamma)
+    {
+        RandRWorker::instance()->setBrightness(m_id, m_proposedBrightness, red, green, blue, 3000);
+        m_currentBrightness = m_proposedBrightness;
+        m_previewedBrightness = -1;
+        m_previewOrigin = GammaRamps();
+    }
     
     
 
@@ -487,7 +557,10 @@ bool RandRCrtc::applyProposed()
         m_currentMode = mode.id();
         m_currentRotation = m_proposedRotation;
         m_currentRect = m_proposedRect;
+        m_currentArea = area;
         m_currentRate = mode.refreshRate();
+        m_currentTransform = transform;
+        m_transformPending = false;
         m_currentVirtualRect = m_proposedVirtualRect;
         m_currentTracking = m_proposedTracking;
         m_currentVirtualModeEnabled = m_proposedVirtualModeEnabled;
@@ -501,7 +574,10 @@ bool RandRCrtc::applyProposed()
         ret = false;
         // Invalidate the XRRScreenResources cache
         if(s == RRSetConfigInvalidConfigTime)
+        {
+            m_screen->invalidate();
             m_screen->loadSettings(true);
+        }
     }
 
     if(!m_proposedVirtualModeEnabled)
@@ -534,6 +610,12 @@ bool RandRCrtc::proposeVirtualModeEnabled(bool enabled)
     return true;
 }
 
+bool RandRCrtc::proposeTransform(const RandRTransform &transform)
+{
+    m_proposedTransform = transform;
+    return true;
+}
+
 bool RandRCrtc::proposePosition(const QPoint &p)
 {
     m_proposedRect.moveTopLeft(p);
@@ -563,6 +645,59 @@ bool RandRCrtc::proposeBrightness(float _brightness)
     return true;
 }
 
+void RandRCrtc::previewBrightness(float brightness)
+{
+    if (!m_screen->capabilities().gamma || !isValid())
+        return;
+
+    // the slider works in percent, the gamma ramps rarely give back exactly
+    // what was set
+    bool current = qRound(brightness * 100) == qRound(m_currentBrightness * 100);
+    if (current && m_previewedBrightness < 0)
+        return;
+
+    // keep what was on screen before, for a rollback to go back to
+    if (m_previewedBrightness < 0)
+        m_previewOrigin = get_gamma_ramps(QX11Info::display(), m_id);
+    else if (current)
+        m_previewOrigin = GammaRamps();
+
+    m_previewedBrightness = current ? -1 : brightness;
+
+    // one upload per frame of the output is all it can show
+    int interval = m_currentRate > 0 ? qRound(1000 / m_currentRate) : 16;
+    RandRWorker::instance()->previewBrightness(m_id, current ? m_currentBrightness : brightness,
+                                               red, green, blue, interval);
+}
+
+float RandRCrtc::previewedBrightness() const
+{
+    return m_previewedBrightness;
+}
+
+GammaRamps RandRCrtc::previewOrigin() const
+{
+    return m_previewOrigin;
+}
+
+void RandRCrtc::commitPreview()
+{
+    if (m_previewedBrightness < 0)
+        return;
+
+    m_currentBrightness = m_previewedBrightness;
+    m_previewedBrightness = -1;
+    m_previewOrigin = GammaRamps();
+}
+
+void RandRCrtc::cancelPreview()
+{
+    if (m_previewedBrightness < 0)
+        return;
+
+    previewBrightness(m_currentBrightness);
+}
+
 void RandRCrtc::proposeOriginal()
 {
     m_proposedRotation = m_originalRotation;
@@ -572,6 +707,7 @@ void RandRCrtc::proposeOriginal()
     m_proposedVirtualRect = m_originalVirtualRect;
     m_proposedTracking = m_originalTracking;
     m_proposedVirtualModeEnabled = m_originalVirtualModeEnabled;
+    m_proposedTransform = m_originalTransform;
 }
 
 void RandRCrtc::setOriginal()
@@ -583,6 +719,7 @@ void RandRCrtc::setOriginal()
     m_originalVirtualRect = m_currentVirtualRect;
     m_originalTracking = m_currentTracking;
     m_originalVirtualModeEnabled = m_currentVirtualModeEnabled;
+    m_originalTransform = m_currentTransform;
 }
 
 bool RandRCrtc::proposedChanged()
@@ -593,7 +730,8 @@ bool RandRCrtc::proposedChanged()
         m_proposedBrightness != m_currentBrightness ||
         m_proposedVirtualRect != m_currentVirtualRect ||
         m_proposedTracking != m_currentTracking ||
-        m_proposedVirtualModeEnabled != m_currentVirtualModeEnabled);
+        m_proposedVirtualModeEnabled != m_currentVirtualModeEnabled ||
+        m_proposedTransform != m_currentTransform);
 }
 
 bool RandRCrtc::addOutput(RROutput output, const QSize &s)
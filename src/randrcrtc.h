@@ -23,8 +23,11 @@
 #include <QtGui/QX11Info>
 #include <QtCore/QObject>
 #include <QtCore/QRect>
+#include <QtCore/QSizeF>
 
 #include "randr.h"
+#include "randrtransform.h"
+#include "randrgammainfo.h"
 
 /** Class representing a CRT controller. */
 class RandRCrtc : public QObject
@@ -42,11 +45,21 @@ public:
     void loadSettings(bool notify = false);
     void handleEvent(XRRCrtcChangeNotifyEvent *event);
 
+    /** Generation of the last screen refresh this CRTC was seen in. */
+    uint generation() const;
+    void setGeneration(uint generation);
+
     bool isValid(void) const;
     RandRMode mode() const;
     QRect rect() const;
+    /** The rect in the space proposeSize() works in: the position and
+     * mode size of a transformed CRTC, rect() for any other. */
+    QRect modeRect() const;
     float refreshRate() const;
 
+    /** The transform of this CRTC; rect() is the transformed area. */
+    RandRTransform transform() const;
+
     bool proposeSize(const QSize &s);
     bool proposePosition(const QPoint &p);
     bool proposeRotation(int rotation);
@@ -55,6 +68,21 @@ public:
     bool proposeTracking(bool tracking);
     bool proposeVirtualSize(const QSize &size);
     bool proposeVirtualModeEnabled(bool enable);
+    bool proposeTransform(const RandRTransform &transform);
+
+    /** Shows a brightness right away by uploading only the gamma ramps,
+     * without configuring the CRTC. Previewing the current brightness
+     * ends the preview. */
+    void previewBrightness(float brightness);
+    /** The brightness on screen through a preview, or -1 if none is. */
+    float previewedBrightness() const;
+    /** Takes the previewed brightness as the current one. */
+    void commitPreview();
+    /** Puts the current brightness back on screen if a preview is showing. */
+    void cancelPreview();
+    /** The gamma ramps that were on screen before the preview that is
+     * showing, empty if none is. */
+    GammaRamps previewOrigin() const;
 
     // applying stuff
     bool applyProposed();
@@ -84,7 +112,8 @@ private:
     RRCrtc m_id;
     RRMode m_currentMode;
 
-    QRect m_currentRect;
+    QRect m_currentRect;        // position and mode size, what proposals use
+    QRect m_currentArea;        // the framebuffer area shown, see rect()
     QRect m_currentVirtualRect;
     float m_currentRate;
     int m_currentRotation;
@@ -94,6 +123,8 @@ private:
     float m_currentGreen;
     bool m_currentTracking;
     bool m_currentVirtualModeEnabled;
+    RandRTransform m_currentTransform;
+    bool m_transformPending;
 
 
     QRect m_originalRect;
@@ -103,6 +134,7 @@ private:
     float m_originalBrightness;
     bool m_originalTracking;
     bool m_originalVirtualModeEnabled;
+    RandRTransform m_originalTransform;
 
     QRect m_proposedRect;
     QRect m_proposedVirtualRect;
@@ -112,17 +144,19 @@ private:
     float m_proposedRed;
     float m_proposedGreen;
     float m_proposedBlue;
+    float m_previewedBrightness;
+    GammaRamps m_previewOrigin;
     bool m_proposedTracking;
     bool m_proposedVirtualModeEnabled;
+    RandRTransform m_proposedTransform;
 
     OutputList m_connectedOutputs;
     OutputList m_possibleOutputs;
     int m_rotations;
-    
-    XTransform m_transform;
-    char *m_filter;
+
 
     RandRScreen *m_screen;
+    uint m_generation;
 };
 
 #endif // RANDRCRTC_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include "randrcrtcallocator.h"
+
+RandRCrtcAllocator::RandRCrtcAllocator()
+{
+}
+
+void RandRCrtcAllocator::addOutput(RROutput output, const CrtcList &possible, RRCrtc current)
+{
+    if (m_outputs.indexOf(output) != -1)
+        return;
+
+    // try the current CRTC first so that augmenting paths keep it if they can
+    CrtcList crtcs;
+    if (current != None && possible.indexOf(current) != -1)
+        crtcs.append(current);
+    foreach(RRCrtc c, possible)
+    {
+        if (c != current)
+            crtcs.append(c);
+    }
+
+    m_outputs.append(output);
+    m_possible[output] = crtcs;
+    m_current[output] = current;
+}
+
+void RandRCrtcAllocator::reserveCrtc(RRCrtc crtc)
+{
+    if (m_reserved.indexOf(crtc) == -1)
+        m_reserved.append(crtc);
+}
+
+bool RandRCrtcAllocator::solve()
+{
+    m_outputCrtc.clear();
+    m_crtcOutput.clear();
+
+    // start from the current assignment
+    foreach(RROutput o, m_outputs)
+    {
+        RRCrtc c = m_current.value(o, None);
+        if (c == None || m_reserved.indexOf(c) != -1 || m_crtcOutput.contains(c))
+            continue;
+        if (m_possible.value(o).indexOf(c) == -1)
+            continue;
+
+        m_outputCrtc[o] = c;
+        m_crtcOutput[c] = o;
+    }
+
+    // and augment it for every output that is still without a CRTC
+    bool complete = true;
+    foreach(RROutput o, m_outputs)
+    {
+        if (m_outputCrtc.contains(o))
+            continue;
+
+        QList<RRCrtc> visited;
+        if (!augment(o, visited))
+        {
+            qDebug() << "No CRTC available for output" << o;
+            complete = false;
+        }
+    }
+
+    return complete;
+}
+
+bool RandRCrtcAllocator::augment(RROutput output, QList<RRCrtc> &visited)
+{
+    foreach(RRCrtc c, m_possible.value(output))
+    {
+        if (m_reserved.indexOf(c) != -1 || visited.indexOf(c) != -1)
+            continue;
+        visited.append(c);
+
+        // take a free CRTC, or move its owner somewhere else
+        if (!m_crtcOutput.contains(c) || augment(m_crtcOutput.value(c), visited))
+        {
+            m_outputCrtc[output] = c;
+            m_crtcOutput[c] = output;
+            return true;
+        }
+    }
+    return false;
+}
+
+RRCrtc RandRCrtcAllocator::crtc(RROutput output) const
+{
+    return m_outputCrtc.value(output, None);
+}
+
+QMap<RROutput,RRCrtc> RandRCrtcAllocator::assignment() const
+{
+    return m_outputCrtc;
+}
+
+OutputList RandRCrtcAllocator::unassigned() const
+{
+    OutputList list;
+    foreach(RROutput o, m_outputs)
+    {
+        if (!m_outputCrtc.contains(o))
+            list.append(o);
+    }
+    return list;
+}
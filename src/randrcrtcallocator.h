@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRCRTCALLOCATOR_H
+#define RANDRCRTCALLOCATOR_H
+
+#include <QtCore/QMap>
+
+#include "randr.h"
+
+/** Assigns CRTCs to all outputs of a proposed layout at once.
+ *
+ * The assignment is a maximum bipartite matching between outputs and the
+ * CRTCs they can be driven by. Outputs keep the CRTC they are currently on
+ * whenever possible, so a layout change only moves outputs when it has to. */
+class RandRCrtcAllocator
+{
+public:
+    RandRCrtcAllocator();
+
+    /** Adds an output that needs a CRTC. @p current is the CRTC it is
+     * driven by now, or None. */
+    void addOutput(RROutput output, const CrtcList &possible, RRCrtc current = None);
+
+    /** Marks a CRTC as not available, e.g. because an output that is not
+     * part of the layout is still using it. */
+    void reserveCrtc(RRCrtc crtc);
+
+    /** Solves the assignment. Returns true if every output got a CRTC. */
+    bool solve();
+
+    RRCrtc crtc(RROutput output) const;
+    QMap<RROutput,RRCrtc> assignment() const;
+    OutputList unassigned() const;
+
+private:
+    bool augment(RROutput output, QList<RRCrtc> &visited);
+
+    OutputList m_outputs;
+    QMap<RROutput,CrtcList> m_possible;
+    QMap<RROutput,RRCrtc> m_current;
+    CrtcList m_reserved;
+
+    QMap<RROutput,RRCrtc> m_outputCrtc;
+    QMap<RRCrtc,RROutput> m_crtcOutput;
+};
+
+#endif // RANDRCRTCALLOCATOR_H
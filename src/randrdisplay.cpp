@@ -20,6 +20,7 @@
  */
 
 #include <QtCore/QDebug>
+#include <QtCore/QAbstractEventDispatcher>
 #include <QtGui/QApplication>
 #include <QtGui/QDesktopWidget>
 #include <QtGui/QX11Info>
@@ -27,40 +28,34 @@
 #include "randrdisplay.h"
 #ifdef HAS_RANDR_1_2
 #include "randrscreen.h"
+#include "randrconfigstore.h"
 #endif
 #include "legacyrandrscreen.h"
+#include "randrworker.h"
+#include "randrbenchmark.h"
+
+// the displays RandR events are dispatched to, and the event filter that
+// was installed before the first of them
+static QList<RandRDisplay*> s_displays;
+static QAbstractEventDispatcher::EventFilter s_previousFilter = 0;
 
 RandRDisplay::RandRDisplay()
     : m_valid(true)
 {
+    RandRBenchmark::Phase phase("RandRDisplay");
 
     //m_dpy = XOpenDisplay(NULL);
     m_dpy = QX11Info::display();
 
     // Check extension
-    if(XRRQueryExtension(m_dpy, &m_eventBase, &m_errorBase) == False) {
+    if(XRRQueryExtension(m_dpy, &m_capabilities.eventBase, &m_capabilities.errorBase) == False) {
         m_valid = false;
         return;
     }
 
-    int major_version, minor_version;
-    XRRQueryVersion(m_dpy, &major_version, &minor_version);
-
-    m_version = QObject::tr("X Resize and Rotate extension version %1.%2").arg(major_version).arg(minor_version);
-
-    qDebug() << major_version << minor_version << m_version;
-    // check if we have the new version of the XRandR extension
-    RandR::has_1_2 = (major_version > 1 || (major_version == 1 && minor_version >= 2));
-    RandR::has_1_3 = (major_version > 1 || (major_version == 1 && minor_version >= 3));
-
-    if(RandR::has_1_3)
-        qDebug() << "Using XRANDR extension 1.3 or greater.";
-    else if(RandR::has_1_2)
-        qDebug() << "Using XRANDR extension 1.2.";
-    else
-        qDebug() << "Using legacy XRANDR extension (1.1 or earlier).";
+    probeCapabilities();
 
-    qDebug() << "XRANDR error base: " << m_errorBase;
+    qDebug() << "XRANDR error base: " << m_capabilities.errorBase;
 
     qDebug() << m_dpy;
     m_numScreens = ScreenCount(m_dpy);
@@ -78,7 +73,7 @@ RandRDisplay::RandRDisplay()
     {
 #ifdef HAS_RANDR_1_2
         if (RandR::has_1_2)
-            m_screens.append(new RandRScreen(i));
+            m_screens.append(new RandRScreen(i, m_capabilities));
         else
 #endif
             m_legacyScreens.append(new LegacyRandRScreen(i));
@@ -105,10 +100,64 @@ RandRDisplay::RandRDisplay()
     }
 #endif
     setCurrentScreen(DefaultScreen(QX11Info::display()));
+
+    // the screens select RandR input on their root windows, which no widget
+    // receives events for, so take them before Qt dispatches them
+    QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+    if (dispatcher)
+    {
+        if (s_displays.isEmpty())
+            s_previousFilter = dispatcher->setEventFilter(filterEvent);
+        s_displays.append(this);
+    }
+}
+
+void RandRDisplay::probeCapabilities()
+{
+    int major_version, minor_version;
+    XRRQueryVersion(m_dpy, &major_version, &minor_version);
+
+    m_version = QObject::tr("X Resize and Rotate extension version %1.%2").arg(major_version).arg(minor_version);
+
+    qDebug() << major_version << minor_version << m_version;
+
+    // check if we have the new version of the XRandR extension
+    RandR::has_1_2 = (major_version > 1 || (major_version == 1 && minor_version >= 2));
+    RandR::has_1_3 = (major_version > 1 || (major_version == 1 && minor_version >= 3));
+
+    // none of these can change for the lifetime of the connection, so the
+    // rest of the code checks the flags instead of asking the server again
+    m_capabilities.gamma = RandR::has_1_2;
+#ifdef HAS_RANDR_1_3
+    m_capabilities.panning = RandR::has_1_3;
+    m_capabilities.transform = RandR::has_1_3;
+    m_capabilities.primary = RandR::has_1_3;
+#else
+    m_capabilities.panning = false;
+    m_capabilities.transform = false;
+    m_capabilities.primary = false;
+#endif
+
+    if(RandR::has_1_3)
+        qDebug() << "Using XRANDR extension 1.3 or greater.";
+    else if(RandR::has_1_2)
+        qDebug() << "Using XRANDR extension 1.2.";
+    else
+        qDebug() << "Using legacy XRANDR extension (1.1 or earlier).";
 }
 
 RandRDisplay::~RandRDisplay()
 {
+        if (s_displays.removeAll(this) && s_displays.isEmpty())
+        {
+            QAbstractEventDispatcher *dispatcher = QAbstractEventDispatcher::instance();
+            if (dispatcher)
+                dispatcher->setEventFilter(s_previousFilter);
+            s_previousFilter = 0;
+        }
+
+        // pending brightness changes are set before the screens go away
+        RandRWorker::shutdown();
         qDeleteAll(m_legacyScreens);
 #ifdef HAS_RANDR_1_2
         qDeleteAll(m_screens);
@@ -127,12 +176,17 @@ const QString& RandRDisplay::errorCode() const
 
 int RandRDisplay::eventBase() const
 {
-    return m_eventBase;
+    return m_capabilities.eventBase;
 }
 
 int RandRDisplay::errorBase() const
 {
-    return m_errorBase;
+    return m_capabilities.errorBase;
+}
+
+const RandRCapabilities &RandRDisplay::capabilities() const
+{
+    return m_capabilities;
 }
 
 const QString& RandRDisplay::version() const
@@ -168,6 +222,17 @@ int RandRDisplay::currentScreenIndex() const
 
 bool RandRDisplay::needsRefresh() const
 {
+#ifdef HAS_RANDR_1_2
+    if (RandR::has_1_2)
+    {
+        foreach(RandRScreen *s, m_screens)
+        {
+            if (s->needsRefresh())
+                return true;
+        }
+        return false;
+    }
+#endif
     Time time, config_timestamp;
     time = XRRTimes(m_dpy, m_currentScreenIndex, &config_timestamp);
 
@@ -180,6 +245,7 @@ void RandRDisplay::refresh()
 #ifdef HAS_RANDR_1_2
     if (RandR::has_1_2)
     {
+        // screens whose timestamps did not move are skipped by loadSettings()
         for (int i = 0; i < m_screens.count(); ++i)
         {
             RandRScreen* s = m_screens.at(i);
@@ -198,19 +264,32 @@ void RandRDisplay::refresh()
 
 bool RandRDisplay::canHandle(const XEvent *e) const
 {
-    if (e->type == m_eventBase + RRScreenChangeNotify)
+    if (e->type == m_capabilities.eventBase + RRScreenChangeNotify)
         return true;
 #ifdef HAS_RANDR_1_2
-    else if (e->type == m_eventBase + RRNotify)
+    else if (e->type == m_capabilities.eventBase + RRNotify)
         return true;
 #endif
     return false;
 }
 
 
+bool RandRDisplay::filterEvent(void *message)
+{
+    XEvent *e = static_cast<XEvent*>(message);
+    foreach(RandRDisplay *display, s_displays)
+    {
+        if (display->canHandle(e))
+            display->handleEvent(e);
+    }
+
+    // the events are only looked at, Qt still gets to process them
+    return s_previousFilter ? s_previousFilter(message) : false;
+}
+
 void RandRDisplay::handleEvent(XEvent *e)
 {
-    if (e->type == m_eventBase + RRScreenChangeNotify)
+    if (e->type == m_capabilities.eventBase + RRScreenChangeNotify)
     {
 #ifdef HAS_RANDR_1_2
         if (RandR::has_1_2)
@@ -227,11 +306,12 @@ void RandRDisplay::handleEvent(XEvent *e)
         else
 #endif
         {
-            // handle the event
+            // keeps XRRTimes(), used by needsRefresh(), up to date
+            XRRUpdateConfiguration(e);
         }
     }
 #ifdef HAS_RANDR_1_2
-    else if (e->type == m_eventBase + RRNotify)
+    else if (e->type == m_capabilities.eventBase + RRNotify)
     {
         //forward the event to the right screen
         XRRNotifyEvent *event = (XRRNotifyEvent*)e;
@@ -277,21 +357,28 @@ RandRScreen* RandRDisplay::currentScreen()
 
 bool RandRDisplay::loadDisplay(QSettings &config, bool loadScreens)
 {
-    if (loadScreens)
-    {
 #ifdef HAS_RANDR_1_2
-        if (RandR::has_1_2)
+    if (RandR::has_1_2)
+    {
+        // the screens are read from the mapped store, each from the profile
+        // of the displays connected to it; the INI settings are only read
+        // if the store has to be migrated from them
+        RandRConfigStore store;
+        bool stored = store.open();
+        if (loadScreens)
         {
             foreach(RandRScreen *s, m_screens)
-                s->load(config);
-
+                s->load(store);
         }
-        else
+        if (stored)
+            return store.displayFlags() & RandRConfigStore::ApplyOnStartup;
+    }
+    else
 #endif
-        {
-            foreach(LegacyRandRScreen* s, m_legacyScreens)
-                s->load(config);
-        }
+    if (loadScreens)
+    {
+        foreach(LegacyRandRScreen* s, m_legacyScreens)
+            s->load(config);
     }
     return applyOnStartup(config);
 }
@@ -321,8 +408,13 @@ void RandRDisplay::saveDisplay(QSettings &config, bool syncTrayApp)
 #ifdef HAS_RANDR_1_2
     if (RandR::has_1_2)
     {
+        RandRConfigStore store;
+        store.open();
+        quint32 flags = store.displayFlags() & ~RandRConfigStore::SyncTrayApp;
+        store.setDisplayFlags(flags | (syncTrayApp ? RandRConfigStore::SyncTrayApp : 0));
         foreach(RandRScreen *s, m_screens)
-            s->save(config);
+            s->save(store);
+        store.write();
     }
     else
 #endif
@@ -355,6 +447,8 @@ void RandRDisplay::saveStartup(QSettings &config)
     }
     config.setValue( "StartupCommands", commands.join( "\n" ));
     config.endGroup();
+
+    setStoredApplyOnStartup(true);
 }
 
 void RandRDisplay::disableStartup(QSettings &config)
@@ -363,14 +457,33 @@ void RandRDisplay::disableStartup(QSettings &config)
     config.setValue("ApplyOnStartup", false);
     config.remove("StartupCommands");
     config.endGroup();
+
+    setStoredApplyOnStartup(false);
+}
+
+void RandRDisplay::setStoredApplyOnStartup(bool apply)
+{
+#ifdef HAS_RANDR_1_2
+    if (!RandR::has_1_2)
+        return;
+
+    RandRConfigStore store;
+    store.open();
+    quint32 flags = store.displayFlags() & ~RandRConfigStore::ApplyOnStartup;
+    store.setDisplayFlags(flags | (apply ? RandRConfigStore::ApplyOnStartup : 0));
+    store.write();
+#else
+    Q_UNUSED(apply);
+#endif
 }
 
-void RandRDisplay::applyProposed(bool confirm)
+bool RandRDisplay::applyProposed(bool confirm)
 {
+    bool succeed = true;
 #ifdef HAS_RANDR_1_2
     if (RandR::has_1_2)
         foreach(RandRScreen *s, m_screens)
-            s->applyProposed(confirm);
+            succeed &= s->applyProposed(confirm);
     else
 #endif
     {
@@ -379,13 +492,14 @@ void RandRDisplay::applyProposed(bool confirm)
             if (s->proposedChanged()) {
                 if (confirm)
                 {
-                    s->applyProposedAndConfirm();
+                    succeed &= s->applyProposedAndConfirm();
                 }
                 else
                 {
-                    s->applyProposed();
+                    succeed &= s->applyProposed();
                 }
             }
         }
     }
+    return succeed;
 }
@@ -40,6 +40,7 @@ public:
 
     int eventBase() const;
     int errorBase() const;
+    const RandRCapabilities &capabilities() const;
 
     int screenIndexOfWidget(QWidget* widget);
 
@@ -59,8 +60,9 @@ public:
     /**
      * Loads saved settings.
      *
-     * @param config the KConfig object to load from
-     * @param loadScreens whether to call LegacyRandRScreen::load() for each screen
+     * @param config the settings to load legacy screens from; RandR 1.2
+     *        screens are loaded from the RandRConfigStore
+     * @param loadScreens whether to call load() for each screen
      * @retuns true if the settings should be applied on KDE startup.
      */
     bool loadDisplay(QSettings &config, bool loadScreens = true);
@@ -71,12 +73,18 @@ public:
     static bool applyOnStartup(QSettings &config);
     static bool syncTrayApp(QSettings &config);
 
-    void applyProposed(bool confirm = true);
+    /** Returns false if a screen was not changed; the layoutErrors() of
+     * the screen tell why if its layout was refused up front. */
+    bool applyProposed(bool confirm = true);
 
     bool canHandle(const XEvent *e) const;
     void handleEvent(XEvent *e);
 
 private:
+    void probeCapabilities();
+    static bool filterEvent(void *message);
+    void setStoredApplyOnStartup(bool apply);
+
     Display *m_dpy;
     int	m_numScreens;
     int	m_currentScreenIndex;
@@ -88,8 +96,7 @@ private:
     QString	m_errorCode;
     QString	m_version;
 
-    int	m_eventBase;
-    int m_errorBase;
+    RandRCapabilities m_capabilities;
 };
 
 #endif // RANDRDISPLAY_H
@@ -220,3 +220,41 @@ set_gamma(Display *dpy, XRRScreenResources *res, RRCrtc crtc_id, float brightnes
 
 }
 
+GammaRamps get_gamma_ramps(Display *dpy, RRCrtc crtc)
+{
+    GammaRamps ramps;
+    XRRCrtcGamma *crtc_gamma = XRRGetCrtcGamma(dpy, crtc);
+    if (!crtc_gamma)
+        return ramps;
+
+    int size = crtc_gamma->size;
+    ramps.red.resize(size);
+    ramps.green.resize(size);
+    ramps.blue.resize(size);
+    memcpy(ramps.red.data(), crtc_gamma->red, size * sizeof(unsigned short));
+    memcpy(ramps.green.data(), crtc_gamma->green, size * sizeof(unsigned short));
+    memcpy(ramps.blue.data(), crtc_gamma->blue, size * sizeof(unsigned short));
+
+    XRRFreeGamma(crtc_gamma);
+    return ramps;
+}
+
+void set_gamma_ramps(Display *dpy, RRCrtc crtc, const GammaRamps &ramps)
+{
+    int size = ramps.red.count();
+    if (!size || ramps.green.count() != size || ramps.blue.count() != size)
+        return;
+
+    XRRCrtcGamma *crtc_gamma = XRRAllocGamma(size);
+    if (!crtc_gamma) {
+        qDebug() << "Gamma allocation failed.\n";
+        return;
+    }
+
+    memcpy(crtc_gamma->red, ramps.red.constData(), size * sizeof(unsigned short));
+    memcpy(crtc_gamma->green, ramps.green.constData(), size * sizeof(unsigned short));
+    memcpy(crtc_gamma->blue, ramps.blue.constData(), size * sizeof(unsigned short));
+
+    XRRSetCrtcGamma(dpy, crtc, crtc_gamma);
+    XRRFreeGamma(crtc_gamma);
+}
@@ -33,11 +33,28 @@
 #ifndef RANDRGAMMAINFO_H
 #define RANDRGAMMAINFO_H
 
+#include <QtCore/QVector>
 #include <X11/Xlib.h>
 #include <X11/extensions/Xrandr.h>
 
+/* The gamma ramps of a CRTC as the server has them, empty if unknown. */
+struct GammaRamps
+{
+    QVector<unsigned short> red;
+    QVector<unsigned short> green;
+    QVector<unsigned short> blue;
+
+    bool isEmpty() const { return red.isEmpty(); }
+    bool operator==(const GammaRamps &other) const
+    { return red == other.red && green == other.green && blue == other.blue; }
+};
+
 void get_gamma_info(Display *dpy, XRRScreenResources *res, RRCrtc crtc, float *brightness, float *red, float *blue, float *green);
 
 void set_gamma(Display *dpy, XRRScreenResources *res, RRCrtc crtc_id, float brightness, float red, float blue, float green);
 
+GammaRamps get_gamma_ramps(Display *dpy, RRCrtc crtc);
+
+void set_gamma_ramps(Display *dpy, RRCrtc crtc, const GammaRamps &ramps);
+
 #endif
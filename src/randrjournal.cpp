@@ -0,0 +1,272 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtGui/QX11Info>
+
+#include "randrjournal.h"
+#include "randrscreen.h"
+#include "randrcrtc.h"
+#include "randrworker.h"
+#include "randroutput.h"
+#include "randrmode.h"
+#include "randrgammainfo.h"
+
+RandRJournal::RandRJournal()
+    : m_screen(0),
+      m_primary(None)
+{
+}
+
+RandRJournal::~RandRJournal()
+{
+}
+
+bool RandRJournal::isEmpty() const
+{
+    return m_crtcs.isEmpty();
+}
+
+void RandRJournal::clear()
+{
+    m_screen = 0;
+    m_crtcs.clear();
+}
+
+void RandRJournal::record(RandRScreen *screen)
+{
+    clear();
+    m_screen = screen;
+
+    // the configuration comes from the state the CRTCs keep up to date from
+    // the RandR events; the screen size and the gamma ramps are asked for,
+    // Xlib only updates its idea of the size when the events are processed
+    Display *dpy = QX11Info::display();
+    m_size = screenSize();
+    m_sizeMM = QSize(DisplayWidthMM(dpy, screen->index()), DisplayHeightMM(dpy, screen->index()));
+
+    RandROutput *primary = screen->primaryOutput();
+    m_primary = primary ? primary->id() : None;
+
+    foreach(RandRCrtc *crtc, screen->crtcs())
+    {
+        // the placeholder for "no CRTC" is not known to the server
+        if (!crtc->isValid())
+            continue;
+
+        CrtcEntry entry;
+        entry.id = crtc->id();
+        entry.x = crtc->rect().x();
+        entry.y = crtc->rect().y();
+        entry.mode = crtc->mode().isValid() ? crtc->mode().id() : None;
+        entry.rotation = crtc->rotation();
+        entry.outputs = crtc->connectedOutputs();
+
+        entry.hasPanning = m_screen->capabilities().panning;
+        if (crtc->virtualModeEnabled())
+            entry.panning = QRect(QPoint(0, 0), crtc->virtualRect().size());
+
+        entry.hasTransform = m_screen->capabilities().transform;
+        entry.transform = crtc->transform();
+
+        // a brightness preview is not part of the configuration yet
+        if (m_screen->capabilities().gamma && entry.mode != None)
+        {
+            entry.gamma = crtc->previewedBrightness() >= 0 ? crtc->previewOrigin()
+                                                           : get_gamma_ramps(dpy, entry.id);
+        }
+
+        m_crtcs.append(entry);
+    }
+
+    qDebug() << "Recorded" << m_crtcs.count() << "CRTCs for screen" << screen->index();
+}
+
+bool RandRJournal::replay()
+{
+    if (!m_screen)
+        return false;
+
+    qDebug() << "Replaying configuration journal for screen" << m_screen->index();
+
+    Display *dpy = QX11Info::display();
+    XRRScreenResources *res = m_screen->resources();
+    bool succeed = true;
+
+    // brightness still queued for the configuration being rolled back
+    // would overwrite the restored gamma ramps later
+    RandRWorker::cancelBrightness();
+
+    XGrabServer(dpy);
+
+    // turn off everything that differs from the journal first, so that the
+    // framebuffer can be shrunk and outputs can move between CRTCs; the
+    // ones that match are left alone, but for their gamma
+    QList<CrtcEntry> changed;
+    QList<CrtcEntry> unchanged;
+    foreach(const CrtcEntry &entry, m_crtcs)
+    {
+        XRRCrtcInfo *info = XRRGetCrtcInfo(dpy, res, entry.id);
+        if (!info)
+            continue;
+
+        OutputList outputs;
+        for (int j = 0; j < info->noutput; ++j)
+            outputs.append(info->outputs[j]);
+
+        bool same = (info->x == entry.x && info->y == entry.y && info->mode == entry.mode
+                     && info->rotation == entry.rotation && outputs == entry.outputs);
+
+#ifdef HAS_RANDR_1_3
+        XRRCrtcTransformAttributes *attr;
+        if (same && entry.hasTransform && XRRGetCrtcTransform(dpy, entry.id, &attr) && attr)
+        {
+            same = RandRTransform::fromX(attr->currentTransform, attr->currentFilter,
+                                         attr->currentParams, attr->currentNparams) == entry.transform;
+            XFree(attr);
+        }
+
+        if (same && entry.hasPanning && entry.mode != None)
+        {
+            XRRPanning *panning = XRRGetPanning(dpy, res, entry.id);
+            if (panning)
+            {
+                same = QSize(panning->width, panning->height) == entry.panning.size();
+                XRRFreePanning(panning);
+            }
+        }
+#endif
+
+        if (!same && info->mode != None)
+            XRRSetCrtcConfig(dpy, res, entry.id, CurrentTime, 0, 0, None, RR_Rotate_0, NULL, 0);
+        XRRFreeCrtcInfo(info);
+
+        if (same)
+            unchanged.append(entry);
+        else
+            changed.prepend(entry);
+    }
+
+    if (m_size.isValid() && m_size != screenSize())
+        XRRSetScreenSize(dpy, m_screen->rootWindow(), m_size.width(), m_size.height(),
+                         m_sizeMM.width(), m_sizeMM.height());
+
+    // then restore the CRTCs in the reverse order they were recorded in
+    foreach(const CrtcEntry &entry, changed)
+    {
+        if (!restoreCrtc(entry))
+            succeed = false;
+    }
+
+    foreach(const CrtcEntry &entry, unchanged)
+        restoreGamma(entry);
+
+#ifdef HAS_RANDR_1_3
+    if (m_screen->capabilities().primary)
+        XRRSetOutputPrimary(dpy, m_screen->rootWindow(), m_primary);
+#endif
+
+    XUngrabServer(dpy);
+    XSync(dpy, False);
+
+    return succeed;
+}
+
+bool RandRJournal::restoreCrtc(const CrtcEntry &entry)
+{
+    Display *dpy = QX11Info::display();
+    XRRScreenResources *res = m_screen->resources();
+
+#ifdef HAS_RANDR_1_3
+    // the transform only takes effect with the next XRRSetCrtcConfig
+    if (entry.hasTransform)
+    {
+        XTransform transform = entry.transform.fixed();
+        QByteArray filter = entry.transform.filterName();
+        XRRSetCrtcTransform(dpy, entry.id, &transform, filter.data(),
+                            entry.transform.params(), entry.transform.paramCount());
+    }
+#endif
+
+    Status s = RRSetConfigSuccess;
+    if (entry.mode != None)
+    {
+        RROutput *outputs = new RROutput[entry.outputs.count()];
+        for (int i = 0; i < entry.outputs.count(); ++i)
+            outputs[i] = entry.outputs.at(i);
+
+        s = XRRSetCrtcConfig(dpy, res, entry.id, CurrentTime, entry.x, entry.y,
+                             entry.mode, entry.rotation, outputs, entry.outputs.count());
+        delete[] outputs;
+    }
+
+#ifdef HAS_RANDR_1_3
+    if (entry.hasPanning && entry.mode != None)
+    {
+        XRRPanning *panning = XRRGetPanning(dpy, res, entry.id);
+        if (panning)
+        {
+            panning->left = entry.panning.x();
+            panning->top = entry.panning.y();
+            panning->width = entry.panning.width();
+            panning->height = entry.panning.height();
+            panning->track_left = panning->track_top = 0;
+            panning->track_width = panning->track_height = 0;
+            panning->timestamp = CurrentTime;
+            XRRSetPanning(dpy, res, entry.id, panning);
+            XRRFreePanning(panning);
+        }
+    }
+#endif
+
+    restoreGamma(entry);
+
+    if (s != RRSetConfigSuccess)
+    {
+        qDebug() << "Failed to restore CRTC" << entry.id;
+        return false;
+    }
+    return true;
+}
+
+void RandRJournal::restoreGamma(const CrtcEntry &entry)
+{
+    if (entry.gamma.isEmpty() || entry.mode == None)
+        return;
+
+    Display *dpy = QX11Info::display();
+    if (get_gamma_ramps(dpy, entry.id) == entry.gamma)
+        return;
+
+    set_gamma_ramps(dpy, entry.id, entry.gamma);
+}
+
+RROutput RandRJournal::primary() const
+{
+    return m_primary;
+}
+
+QSize RandRJournal::screenSize() const
+{
+    Window root;
+    int x, y;
+    unsigned int width, height, border, depth;
+    if (!XGetGeometry(QX11Info::display(), m_screen->rootWindow(), &root, &x, &y,
+                      &width, &height, &border, &depth))
+        return QSize();
+    return QSize(width, height);
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRJOURNAL_H
+#define RANDRJOURNAL_H
+
+#include <QtCore/QList>
+#include <QtCore/QRect>
+#include <QtCore/QSize>
+#include <QtCore/QString>
+
+#include "randr.h"
+#include "randrtransform.h"
+#include "randrgammainfo.h"
+
+/** Snapshot of the server side configuration of a screen taken before a
+ * layout change, which can be written back in one go if the change fails
+ * or is not confirmed. */
+class RandRJournal
+{
+public:
+    RandRJournal();
+    ~RandRJournal();
+
+    /** Records the current configuration of all CRTCs of @p screen, as
+     * known from the state cached by its CRTCs, along with their gamma
+     * ramps and the size of the screen as the server has them. Must be
+     * called before the first request of a layout change. */
+    void record(RandRScreen *screen);
+    bool isEmpty() const;
+    void clear();
+
+    /** Writes the recorded configuration back with the server grabbed.
+     * CRTCs that already match the journal are left alone. */
+    bool replay();
+
+    /** The primary output that was recorded, and is set again by replay(). */
+    RROutput primary() const;
+
+private:
+    struct CrtcEntry
+    {
+        RRCrtc id;
+        int x;
+        int y;
+        RRMode mode;
+        Rotation rotation;
+        OutputList outputs;
+
+        bool hasPanning;
+        QRect panning;          // empty if panning is off
+
+        bool hasTransform;
+        RandRTransform transform;
+
+        GammaRamps gamma;       // empty if unknown
+    };
+
+    bool restoreCrtc(const CrtcEntry &entry);
+    void restoreGamma(const CrtcEntry &entry);
+    QSize screenSize() const;
+
+    RandRScreen *m_screen;
+    QSize m_size;
+    QSize m_sizeMM;
+    RROutput m_primary;
+    QList<CrtcEntry> m_crtcs;
+};
+
+#endif // RANDRJOURNAL_H
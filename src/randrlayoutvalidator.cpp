@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QObject>
+
+#include "randrlayoutvalidator.h"
+#include "randrscreen.h"
+#include "randrcrtc.h"
+#include "randroutput.h"
+
+RandRLayoutError::RandRLayoutError(Type type, const QString &output, const QSize &size)
+    : m_type(type),
+      m_output(output),
+      m_size(size)
+{
+}
+
+RandRLayoutError::Type RandRLayoutError::type() const
+{
+    return m_type;
+}
+
+QString RandRLayoutError::output() const
+{
+    return m_output;
+}
+
+QSize RandRLayoutError::size() const
+{
+    return m_size;
+}
+
+QString RandRLayoutError::message() const
+{
+    switch (m_type) {
+        case FramebufferTooLarge:
+            return QObject::tr("The layout needs a %1x%2 screen, which is larger than the maximum supported size.")
+                .arg(m_size.width()).arg(m_size.height());
+        case NoCrtc:
+            return QObject::tr("There is no CRT controller left to drive %1.").arg(m_output);
+        case NoMode:
+            return QObject::tr("%1 does not support a %2x%3 mode.")
+                .arg(m_output).arg(m_size.width()).arg(m_size.height());
+        case UnsupportedRotation:
+            return QObject::tr("%1 does not support the selected orientation.").arg(m_output);
+        case CloneMismatch:
+            return QObject::tr("%1 has to share a CRT controller with a clone that uses a different mode.")
+                .arg(m_output);
+    }
+
+    return QString();
+}
+
+RandRLayoutValidator::RandRLayoutValidator(RandRScreen *screen)
+    : m_screen(screen)
+{
+    Q_ASSERT(m_screen);
+}
+
+QRect RandRLayoutValidator::proposedArea(RandROutput *output)
+{
+    // same rule as RandRCrtc::applyProposed: the proposed rect is given in
+    // the orientation the output is in now
+    const int sideways = RandR::Rotate90 | RandR::Rotate270;
+    QRect r = output->proposedRect();
+    if (((output->rotation() & sideways) != 0) != ((output->proposedRotation() & sideways) != 0))
+        r.setSize(QSize(r.height(), r.width()));
+
+    // a transform changes the area the mode covers
+    r.setSize(output->proposedTransform().mapSize(r.size()));
+
+    // a panning area has to fit in the framebuffer as well
+    if (output->proposedVirtualModeEnabled())
+        r = r.united(QRect(r.topLeft(), output->proposedVirtualRect().size()));
+
+    return r;
+}
+
+bool RandRLayoutValidator::validate()
+{
+    m_errors.clear();
+
+    QList<RandROutput*> layout = m_screen->layoutOutputs();
+    QRect bounds;
+
+    m_assignment.clear();
+    m_screen->planCrtcs(m_assignment);
+
+    // outputs grouped by the CRTC they will end up on
+    QMap<RRCrtc,RandROutput*> crtcOwner;
+
+    foreach(RandROutput *o, layout)
+    {
+        if (!o->proposedRect().isValid())
+            continue;
+
+        bounds = bounds.united(proposedArea(o));
+
+        // same rule as RandRCrtc::applyProposed: a mode of exactly the
+        // proposed size
+        QSize size = o->proposedRect().size();
+        if (o->sizes().indexOf(size) == -1)
+            m_errors.append(RandRLayoutError(RandRLayoutError::NoMode, o->name(), size));
+
+        RRCrtc id = m_assignment.value(o->id(), None);
+        RandRCrtc *crtc = m_screen->crtc(id);
+        if (id == None || !crtc)
+        {
+            m_errors.append(RandRLayoutError(RandRLayoutError::NoCrtc, o->name()));
+            continue;
+        }
+
+        int rotation = o->proposedRotation();
+        if ((crtc->rotations() & rotation) != rotation)
+            m_errors.append(RandRLayoutError(RandRLayoutError::UnsupportedRotation, o->name()));
+
+        // clones on one CRTC need the same geometry and a mode they all have
+        RandROutput *owner = crtcOwner.value(id);
+        if (!owner)
+        {
+            crtcOwner[id] = o;
+            continue;
+        }
+        if (owner->proposedRect() != o->proposedRect()
+            || owner->proposedRotation() != o->proposedRotation()
+            || owner->proposedTransform() != o->proposedTransform())
+        {
+            m_errors.append(RandRLayoutError(RandRLayoutError::CloneMismatch, o->name(), size));
+            continue;
+        }
+
+        bool common = false;
+        foreach(RRMode m, o->modes())
+        {
+            if (owner->modes().indexOf(m) != -1 && m_screen->mode(m).size() == size)
+            {
+                common = true;
+                break;
+            }
+        }
+        if (!common)
+            m_errors.append(RandRLayoutError(RandRLayoutError::CloneMismatch, o->name(), size));
+    }
+
+    // the framebuffer reaches from the origin to the far edges of the
+    // outputs; smaller layouts simply get the minimum size, larger ones
+    // cannot work
+    QSize extent(0, 0);
+    if (bounds.isValid())
+        extent = QSize(bounds.right() + 1, bounds.bottom() + 1);
+    m_framebufferSize = extent.expandedTo(m_screen->minSize());
+    if (m_framebufferSize.width() > m_screen->maxSize().width()
+        || m_framebufferSize.height() > m_screen->maxSize().height())
+        m_errors.prepend(RandRLayoutError(RandRLayoutError::FramebufferTooLarge, QString(), m_framebufferSize));
+
+    return m_errors.isEmpty();
+}
+
+QSize RandRLayoutValidator::framebufferSize() const
+{
+    return m_framebufferSize;
+}
+
+LayoutErrorList RandRLayoutValidator::errors() const
+{
+    return m_errors;
+}
+
+QMap<RROutput,RRCrtc> RandRLayoutValidator::assignment() const
+{
+    return m_assignment;
+}
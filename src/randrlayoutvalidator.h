@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRLAYOUTVALIDATOR_H
+#define RANDRLAYOUTVALIDATOR_H
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+
+#include "randr.h"
+
+class RandRLayoutError
+{
+public:
+    enum Type {
+        FramebufferTooLarge,
+        NoCrtc,
+        NoMode,
+        UnsupportedRotation,
+        CloneMismatch
+    };
+
+    RandRLayoutError(Type type, const QString &output = QString(), const QSize &size = QSize());
+
+    Type type() const;
+    /** Name of the output the error refers to, empty for screen wide errors. */
+    QString output() const;
+    QSize size() const;
+    QString message() const;
+
+private:
+    Type m_type;
+    QString m_output;
+    QSize m_size;
+};
+
+typedef QList<RandRLayoutError> LayoutErrorList;
+
+/** Checks a proposed layout against the limits of the screen before any
+ * request is sent to the server, so that layouts which cannot work fail
+ * without changing, and then reverting, anything. */
+class RandRLayoutValidator
+{
+public:
+    RandRLayoutValidator(RandRScreen *screen);
+
+    bool validate();
+
+    /** The framebuffer size the layout needs. Only valid after validate(). */
+    QSize framebufferSize() const;
+    LayoutErrorList errors() const;
+
+    /** The CRTC of every output of the layout. Only valid after
+     * validate(). */
+    QMap<RROutput,RRCrtc> assignment() const;
+
+    /** The area an output covers with its proposed mode, rotation and
+     * panning. */
+    static QRect proposedArea(RandROutput *output);
+
+private:
+    RandRScreen *m_screen;
+    QSize m_framebufferSize;
+    LayoutErrorList m_errors;
+    QMap<RROutput,RRCrtc> m_assignment;
+};
+
+#endif // RANDRLAYOUTVALIDATOR_H
@@ -18,14 +18,16 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <QtCore/QSettings>
 #include <QtGui/QX11Info>
 #include <QtGui/QAction>
+#include <X11/Xatom.h>
+#include <string.h>
 
 #include "randroutput.h"
 #include "randrscreen.h"
 #include "randrcrtc.h"
 #include "randrmode.h"
+#include "randrconfigstore.h"
 
 RandROutput::RandROutput(RandRScreen *parent, RROutput id)
 : QObject(parent)
@@ -36,6 +38,7 @@ RandROutput::RandROutput(RandRScreen *parent, RROutput id)
     m_id = id;
     m_crtc = 0;
     m_rotations = 0;
+    m_generation = 0;
 
     queryOutputInfo();
 
@@ -46,6 +49,7 @@ RandROutput::RandROutput(RandRScreen *parent, RROutput id)
     m_proposedVirtualRect = m_originalVirtualRect;
     m_proposedTracking = m_originalTracking;
     m_proposedVirtualModeEnabled = m_originalVirtualModeEnabled;
+    m_proposedTransform = m_originalTransform;
 }
 
 RandROutput::~RandROutput()
@@ -62,6 +66,16 @@ RandRScreen *RandROutput::screen() const
     return m_screen;
 }
 
+uint RandROutput::generation() const
+{
+    return m_generation;
+}
+
+void RandROutput::setGeneration(uint generation)
+{
+    m_generation = generation;
+}
+
 void RandROutput::queryOutputInfo(void)
 {
     XRROutputInfo *info = XRRGetOutputInfo(QX11Info::display(), m_screen->resources(), m_id);
@@ -74,13 +88,20 @@ void RandROutput::queryOutputInfo(void)
     // CRT controller.
     m_connected = (info->connection == RR_Connected);
     m_name = info->name;
+    m_physicalSize = QSize(info->mm_width, info->mm_height);
+    if (m_connected)
+        queryEdid();
+    else
+        m_edidSerial.clear();
 
     qDebug() << "XID" << m_id << "is output" << m_name <<
                 (isConnected() ? "(connected)" : "(disconnected)");
 
-    setCrtc(m_screen->crtc(info->crtc));
+    // only bind to the CRTC the server reports, do not apply anything here
+    setCrtc(m_screen->crtc(info->crtc), false);
     qDebug() << "Possible CRTCs for output" << m_name << ":";
 
+    m_possibleCrtcs.clear();
     if (!info->ncrtc) {
         qDebug() << "   - none";
     }
@@ -109,11 +130,12 @@ void RandROutput::queryOutputInfo(void)
     }
     m_originalRotation = m_crtc->rotation();
     m_originalRate     = m_crtc->refreshRate();
-    m_originalRect     = m_crtc->rect();
+    m_originalRect     = modeRect();
     m_originalBrightness = m_crtc->brightness();
     m_originalVirtualRect = m_crtc->virtualRect();
     m_originalTracking = m_crtc->tracking();
     m_originalVirtualModeEnabled = m_crtc->virtualModeEnabled();
+    m_originalTransform = m_crtc->transform();
 
     if(isConnected()) {
         qDebug() << "Current configuration for output" << m_name << ":";
@@ -127,46 +149,22 @@ void RandROutput::queryOutputInfo(void)
 
 void RandROutput::loadSettings(bool notify)
 {
-    Q_UNUSED(notify);
-    queryOutputInfo();
-
-    qDebug() << "STUB: calling queryOutputInfo instead. Check if this has "
-                "any undesired effects. ";
-
-    /*
     int changes = 0;
+    RandRCrtc *oldCrtc = m_crtc;
+    bool oldConnected = m_connected;
+    ModeList oldModes = m_modes;
 
-    XRROutputInfo *info = XRRGetOutputInfo(QX11Info::display(), m_screen->resources(), m_id);
-    Q_ASSERT(info);
-
-    if (RandR::timestamp != info->timestamp)
-        RandR::timestamp = info->timestamp;
-
-    m_possibleCrtcs.clear();
-    for (int i = 0; i < info->ncrtc; ++i)
-        m_possibleCrtcs.append(info->crtcs[i]);
+    queryOutputInfo();
 
-    //check if the crtc changed
-    if (info->crtc != m_crtc->id())
-    {
-        kDebug() << "CRTC changed for " << m_name << ": " << info->crtc;
-        setCrtc(m_screen->crtc(info->crtc));
+    if (m_crtc != oldCrtc)
         changes |= RandR::ChangeCrtc;
-    }
-
-    bool connected = (info->connection == RR_Connected);
-    if (connected != m_connected)
-    {
-        m_connected = connected;
+    if (m_connected != oldConnected)
         changes |= RandR::ChangeConnection;
-    }
-
-    // free the info
-    XRRFreeOutputInfo(info);
+    if (m_modes != oldModes)
+        changes |= RandR::ChangeMode;
 
     if (changes && notify)
         emit outputChanged(m_id, changes);
-    */
 }
 
 void RandROutput::handleEvent(XRROutputChangeNotifyEvent *event)
@@ -233,6 +231,66 @@ void RandROutput::handlePropertyEvent(XRROutputPropertyNotifyEvent *event)
     XFree(name);
 }
 
+void RandROutput::queryEdid()
+{
+    m_edidSerial.clear();
+
+    // older drivers use EdidData instead of the standard name
+    const char *names[] = { "EDID", "EdidData" };
+    for (int n = 0; n < 2 && m_edidSerial.isEmpty(); ++n)
+    {
+        Atom atom = XInternAtom(QX11Info::display(), names[n], True);
+        if (atom == None)
+            continue;
+
+        Atom type;
+        int format;
+        unsigned long nitems, after;
+        unsigned char *data = 0;
+        if (XRRGetOutputProperty(QX11Info::display(), m_id, atom, 0, 32, False, False,
+                                 AnyPropertyType, &type, &format, &nitems, &after,
+                                 &data) != Success)
+            continue;
+
+        static const unsigned char header[8] = { 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00 };
+        if (type == XA_INTEGER && format == 8 && nitems >= 128 && !memcmp(data, header, 8))
+        {
+            // three letters of 5 bits each, 'A' is 1
+            QString manufacturer;
+            manufacturer += QChar('A' - 1 + ((data[8] >> 2) & 0x1f));
+            manufacturer += QChar('A' - 1 + (((data[8] & 0x3) << 3) | (data[9] >> 5)));
+            manufacturer += QChar('A' - 1 + (data[9] & 0x1f));
+            uint product = data[10] | (data[11] << 8);
+            quint32 serial = data[12] | (data[13] << 8) | (data[14] << 16) | ((quint32) data[15] << 24);
+
+            // the serial string of a display descriptor is preferred over
+            // the number, which many vendors leave empty
+            QString serialText;
+            for (int d = 54; d < 126; d += 18)
+            {
+                if (data[d] || data[d + 1] || data[d + 2] || data[d + 3] != 0xff)
+                    continue;
+                serialText = QString::fromLatin1(reinterpret_cast<const char*>(data + d + 5), 13)
+                             .section('\n', 0, 0).trimmed();
+            }
+            if (serialText.isEmpty())
+                serialText = QString::number(serial);
+
+            m_edidSerial = QString("%1%2:%3").arg(manufacturer).arg(product, 4, 16, QChar('0'))
+                                             .arg(serialText);
+        }
+        if (data)
+            XFree(data);
+    }
+
+    qDebug() << "EDID serial of" << m_name << ":" << m_edidSerial;
+}
+
+QString RandROutput::edidSerial() const
+{
+    return m_edidSerial;
+}
+
 QString RandROutput::name() const
 {
     return m_name;
@@ -336,6 +394,11 @@ float RandROutput::refreshRate() const
     return m_crtc->mode().refreshRate();
 }
 
+QSize RandROutput::physicalSize() const
+{
+    return m_physicalSize;
+}
+
 int RandROutput::rotations() const
 {
     return m_rotations;
@@ -389,22 +452,52 @@ void RandROutput::proposeOriginal()
     m_proposedVirtualRect = m_originalVirtualRect;
     m_proposedTracking = m_originalTracking;
     m_proposedVirtualModeEnabled = m_originalVirtualModeEnabled;
+    m_proposedTransform = m_originalTransform;
 
     if (m_crtc->id() != None)
         m_crtc->proposeOriginal();
 }
 
-void RandROutput::load(QSettings &config)
+QRect RandROutput::proposedRect() const
+{
+    return m_proposedRect;
+}
+
+int RandROutput::proposedRotation() const
+{
+    return m_proposedRotation;
+}
+
+QRect RandROutput::proposedVirtualRect() const
+{
+    return m_proposedVirtualRect;
+}
+
+bool RandROutput::proposedVirtualModeEnabled() const
+{
+    return m_proposedVirtualModeEnabled;
+}
+
+RandRTransform RandROutput::proposedTransform() const
+{
+    return m_proposedTransform;
+}
+
+QRect RandROutput::modeRect() const
+{
+    if (m_crtc->transform().isIdentity() || !m_crtc->mode().isValid())
+        return m_crtc->rect();
+    return m_crtc->modeRect();
+}
+
+void RandROutput::load(const RandRConfigStore &store)
 {
     if (!m_connected)
         return;
 
-    config.beginGroup("Screen_" + QString::number(m_screen->index()) +
-                                   "_Output_" + m_name);
-
-    bool active = config.value("Active", true).toBool();
+    RandRConfigStore::OutputRecord record = store.output(m_screen->index(), m_name);
 
-    if (!active && !m_screen->outputsUnified())
+    if (!(record.flags & RandRConfigStore::Active) && !m_screen->outputsUnified())
     {
         setCrtc(m_screen->crtc(None));
         return;
@@ -426,34 +519,27 @@ void RandROutput::load(QSettings &config)
     // if the outputs are unified, the screen will handle size changing
     if (!m_screen->outputsUnified() || m_screen->connectedCount() <= 1)
     {
-        m_proposedRect = (config.value("Rect", "0,0,0,0") == "0,0,0,0")
-            ? QRect() // "0,0,0,0" (serialization for QRect()) does not convert to a QRect
-            : config.value("Rect", QRect()).toRect();
-        m_proposedRotation = config.value("Rotation", (int) RandR::Rotate0).toInt();
+        m_proposedRect = RandRConfigStore::rect(record.rect);
+        m_proposedRotation = record.rotation;
     }
-    m_proposedRate = config.value("RefreshRate", 0).toFloat();
-    m_proposedBrightness = config.value("Brightness", 0).toFloat();
-    m_proposedTracking = config.value("Tracking", false).toBool();
-    m_proposedVirtualRect = config.value("VirtualRect", QRect()).toRect();
-    m_proposedVirtualModeEnabled = config.value("VirtualModeEnabled", false).toBool();
-    config.endGroup();
+    m_proposedRate = record.refreshRate;
+    m_proposedBrightness = record.brightness;
+    m_proposedTracking = record.flags & RandRConfigStore::Tracking;
+    m_proposedVirtualRect = RandRConfigStore::rect(record.virtualRect);
+    m_proposedVirtualModeEnabled = record.flags & RandRConfigStore::VirtualModeEnabled;
 }
 
-void RandROutput::save(QSettings &config)
+void RandROutput::save(RandRConfigStore &store)
 {
-    config.beginGroup("Screen_" + QString::number(m_screen->index()) +
-                                   "_Output_" + m_name);
     if (!m_connected)
-    {
-        config.endGroup();
         return;
-    }
 
-    config.setValue("Active", isActive());
+    RandRConfigStore::OutputRecord record = store.output(m_screen->index(), m_name);
 
     if (!isActive())
     {
-        config.endGroup();
+        record.flags &= ~RandRConfigStore::Active;
+        store.setOutput(record);
         return;
     }
 
@@ -462,15 +548,18 @@ void RandROutput::save(QSettings &config)
     // when the outputs are not unified.
     if (!m_screen->outputsUnified() || m_screen->connectedCount() <=1)
     {
-        config.setValue("Rect", m_crtc->rect());
-        config.setValue("Rotation", m_crtc->rotation());
+        RandRConfigStore::setRect(record.rect, m_crtc->rect());
+        record.rotation = m_crtc->rotation();
     }
-    config.setValue("RefreshRate", (double)m_crtc->refreshRate());
-    config.setValue("Brightness", (double)m_crtc->brightness());
-    config.setValue("Tracking", m_crtc->tracking());
-    config.setValue("VirtualRect", m_crtc->virtualRect());
-    config.setValue("VirtualModeEnabled", m_crtc->virtualModeEnabled());
-    config.endGroup();
+    record.flags = RandRConfigStore::Active;
+    if (m_crtc->tracking())
+        record.flags |= RandRConfigStore::Tracking;
+    if (m_crtc->virtualModeEnabled())
+        record.flags |= RandRConfigStore::VirtualModeEnabled;
+    record.refreshRate = m_crtc->refreshRate();
+    record.brightness = m_crtc->brightness();
+    RandRConfigStore::setRect(record.virtualRect, m_crtc->virtualRect());
+    store.setOutput(record);
 }
 
 QStringList RandROutput::startupCommands() const
@@ -519,7 +608,7 @@ void RandROutput::proposeRect(const QRect &r)
     if (!m_crtc->isValid())
         slotEnable();
 
-    m_originalRect = rect();
+    m_originalRect = modeRect();
     m_proposedRect = r;
 }
 
@@ -569,6 +658,20 @@ void RandROutput::proposeVirtualModeEnabled(bool enabled)
     m_proposedVirtualModeEnabled = enabled;
 }
 
+void RandROutput::proposeTransform(const RandRTransform &transform)
+{
+    if (!m_crtc->isValid())
+        slotEnable();
+
+    m_originalTransform = m_crtc->transform();
+    m_proposedTransform = transform;
+}
+
+void RandROutput::proposeScale(const QSizeF &scale)
+{
+    proposeTransform(RandRTransform::scale(scale));
+}
+
 void RandROutput::slotChangeSize(QAction *action)
 {
     QSize size = action->data().toSize();
@@ -600,12 +703,17 @@ void RandROutput::slotChangeBrightness(QAction *action)
     applyProposed(RandR::ChangeBrightness, true);
 }
 
-void RandROutput::slotDisable()
+void RandROutput::proposeDisable()
 {
     m_originalRect = rect();
     m_proposedRect = QRect();
     m_originalRate = refreshRate();
     m_proposedRate = 0;
+}
+
+void RandROutput::slotDisable()
+{
+    proposeDisable();
     setCrtc(m_screen->crtc(None));
 }
 
@@ -680,6 +788,8 @@ bool RandROutput::tryCrtc(RandRCrtc *crtc, int changes)
         crtc->proposeTracking(m_proposedTracking);
         crtc->proposeVirtualModeEnabled(m_proposedVirtualModeEnabled);
     }
+    if (changes & RandR::ChangeTransform)
+        crtc->proposeTransform(m_proposedTransform);
     
     if (crtc->applyProposed()) {
         qDebug() << "Changed output" << m_name << "to CRTC" << crtc->id();
@@ -703,17 +813,26 @@ bool RandROutput::applyProposed(int changes, bool confirm)
     // If disabled, save anyway to ensure it's saved
     if (!isConnected())
     {
-        QSettings cfg;
-        save(cfg);
+        m_screen->save();
         return true;
     }
     // Don't try to disable an already disabled output.
     if (!m_proposedRect.isValid() && !m_crtc->isValid()) {
         return true;
     }
+    // A previewed brightness is on screen already, so it only needs to be
+    // taken over; if nothing else changed, the CRTC is left alone.
+    bool previewed = (changes & RandR::ChangeBrightness) && m_crtc->isValid()
+                     && m_crtc->previewedBrightness() == m_proposedBrightness;
+    if (previewed)
+        m_crtc->commitPreview();
+
     // Don't try to change an enabled output if there is nothing to change.
     if (m_crtc->isValid()
-        && (m_crtc->rect() == m_proposedRect || !(changes & RandR::ChangeRect))
+        && (m_crtc->rect() == QRect(m_proposedRect.topLeft(), m_proposedTransform.mapSize(m_proposedRect.size()))
+            || !(changes & RandR::ChangeRect))
+        && (m_crtc->transform() == m_proposedTransform.normalized(m_proposedRect.size())
+            || !(changes & RandR::ChangeTransform))
         && (m_crtc->rotation() == m_proposedRotation || !(changes & RandR::ChangeRotation))
         && ((m_crtc->refreshRate() == m_proposedRate || !m_proposedRate || !(changes & RandR::ChangeRate)))
         && (m_crtc->brightness() == m_proposedBrightness || !(changes & RandR::ChangeBrightness))
@@ -721,11 +840,13 @@ bool RandROutput::applyProposed(int changes, bool confirm)
         )
     {
         qDebug() << "No changes for output" << m_name;
+        if (previewed)
+            m_screen->save();
         return true;
     }
     qDebug() << "Applying proposed changes for output" << m_name << "...";
 
-    QSettings cfg;
+    // settings are written behind by the screen, once all outputs are done
     RandRCrtc *crtc;
 
     // first try to apply to the already attached crtc if any
@@ -736,7 +857,7 @@ bool RandROutput::applyProposed(int changes, bool confirm)
         {
             if ( !confirm || (confirm && RandR::confirm(crtc->rect())) )
             {
-                save(cfg);
+                m_screen->save();
                 return true;
             }
             else
@@ -761,7 +882,7 @@ bool RandROutput::applyProposed(int changes, bool confirm)
     {
         if ( !confirm || (confirm && RandR::confirm(crtc->rect())) )
         {
-            save(cfg);
+            m_screen->save();
             return true;
         }
         else
@@ -808,6 +929,11 @@ void RandROutput::disconnectFromCrtc()
     setCrtc(m_screen->crtc(None), false);
 }
 
+void RandROutput::assignCrtc(RandRCrtc *crtc)
+{ // but don't apply now either
+    setCrtc(crtc, false);
+}
+
 void RandROutput::slotCrtcChanged(RRCrtc c, int changes)
 {
     Q_UNUSED(c);
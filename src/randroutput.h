@@ -24,12 +24,14 @@
 #include <QtCore/QObject>
 #include <QtCore/QString>
 #include <QtCore/QRect>
+#include <QtCore/QSizeF>
 
 #include "randr.h"
 #include "randrmode.h"
+#include "randrtransform.h"
 
 class QAction;
-class QSettings;
+class RandRConfigStore;
 
 /** Class representing an RROutput identifier. This class is used
  * to control a particular output's configuration (i.e., the mode or
@@ -50,6 +52,10 @@ public:
 
     void loadSettings(bool notify = false);
 
+    /** Generation of the last screen refresh this output was seen in. */
+    uint generation() const;
+    void setGeneration(uint generation);
+
     /** Handle an event from RANDR signifying a change in this output's
      * configuration. */
     void handleEvent(XRROutputChangeNotifyEvent *event);
@@ -72,6 +78,10 @@ public:
 
     void disconnectFromCrtc();
 
+    /** Binds this output to @p crtc without applying anything. Used by
+     * RandRScreen to hand out the CRTCs of a whole layout at once. */
+    void assignCrtc(RandRCrtc *crtc);
+
     /** Returns a list of all RRModes supported by this output. */
     ModeList modes() const;
 
@@ -82,6 +92,15 @@ public:
      * or an invalid mode if no preferred mode is known. */
     RandRMode preferredMode() const;
 
+    /** Physical size of the display in millimetres as reported by the
+     * EDID, or an empty size if unknown. */
+    QSize physicalSize() const;
+
+    /** Manufacturer, product code and serial of the connected display as
+     * read from its EDID, e.g. "DEL4098:7MT0187C", or an empty string if
+     * the driver does not expose the EDID. */
+    QString edidSerial() const;
+
     /** The list of supported sizes */
     SizeList sizes() const;
     QRect rect() const;
@@ -128,6 +147,12 @@ public:
     bool applyProposed(int changes = 0xffffff, bool confirm = false);
     void proposeOriginal();
 
+    QRect proposedRect() const;
+    int proposedRotation() const;
+    QRect proposedVirtualRect() const;
+    bool proposedVirtualModeEnabled() const;
+    RandRTransform proposedTransform() const;
+
     // proposal functions
     void proposeRefreshRate(float rate);
     void proposeRect(const QRect &r);
@@ -136,9 +161,18 @@ public:
     void proposeTracking(bool tracking);
     void proposeVirtualSize(const QSize &size);
     void proposeVirtualModeEnabled(bool enabled);
-
-    void load(QSettings &config);
-    void save(QSettings &config);
+    /** Proposes to turn the output off. It keeps its CRTC until the
+     * screen hands the CRTCs out for the whole layout. */
+    void proposeDisable();
+
+    /** Transforms the framebuffer area shown on this output, e.g. to
+     * scale an area larger than the mode onto it. The proposed rect keeps
+     * the mode size. */
+    void proposeTransform(const RandRTransform &transform);
+    void proposeScale(const QSizeF &scale);
+
+    void load(const RandRConfigStore &store);
+    void save(RandRConfigStore &store);
     QStringList startupCommands() const;
 
 public slots:
@@ -174,6 +208,11 @@ protected:
      * this function to properly manage signals related to this output. */
     bool setCrtc(RandRCrtc *crtc, bool applyNow = true);
 
+    /** The current rect with the mode size, before any scaling. */
+    QRect modeRect() const;
+
+    void queryEdid();
+
 private:
     RROutput m_id;
     XRROutputInfo* m_info;
@@ -193,6 +232,7 @@ private:
     QRect m_proposedVirtualRect;
     bool m_proposedTracking;
     bool m_proposedVirtualModeEnabled;
+    RandRTransform m_proposedTransform;
 
     QRect m_originalRect;
     int   m_originalRotation;
@@ -201,12 +241,16 @@ private:
     QRect m_originalVirtualRect;
     bool m_originalTracking;
     bool m_originalVirtualModeEnabled;
+    RandRTransform m_originalTransform;
 
     ModeList m_modes;
     RandRMode m_preferredMode;
+    QSize m_physicalSize;
+    QString m_edidSerial;
 
     int m_rotations;
     bool m_connected;
+    uint m_generation;
 };
 
 #endif // RANDROUTPUT_H
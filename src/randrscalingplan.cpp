@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDebug>
+#include <math.h>
+
+#include "randrscalingplan.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+#include "layoutsolver.h"
+
+RandRScalingPlan::RandRScalingPlan(RandRScreen *screen)
+    : m_screen(screen),
+      m_referenceDpi(96.0),
+      m_step(0.25),
+      m_desktopScale(1.0)
+{
+}
+
+void RandRScalingPlan::setReferenceDpi(qreal dpi)
+{
+    m_referenceDpi = dpi;
+}
+
+void RandRScalingPlan::setScaleStep(qreal step)
+{
+    m_step = step;
+}
+
+qreal RandRScalingPlan::density(RandROutput *output, const QSize &mode) const
+{
+    QSize mm = output->physicalSize();
+    if (mm.isEmpty())
+        return m_referenceDpi;
+
+    // the EDID size is that of the unrotated panel, while the proposed rect
+    // is given in the orientation the output is in now
+    QSize size = mode;
+    if (output->rotation() & (RandR::Rotate90 | RandR::Rotate270))
+        size.transpose();
+
+    // some projectors and TVs report their aspect ratio as size
+    qreal dpi = 25.4 * size.width() / mm.width();
+    if (dpi < 50 || dpi > 1000)
+        return m_referenceDpi;
+    return dpi;
+}
+
+bool RandRScalingPlan::compute()
+{
+    m_plans.clear();
+    m_index.clear();
+    m_desktopScale = 1.0;
+    m_framebufferSize = QSize();
+
+    foreach(RandROutput *output, m_screen->layoutOutputs())
+    {
+        if (!output->proposedRect().isValid())
+            continue;
+
+        Plan plan;
+        plan.output = output;
+        plan.mode = output->proposedRect().size();
+
+        qreal scale = density(output, plan.mode) / m_referenceDpi;
+        if (m_step > 0)
+            scale = floor(scale / m_step + 0.5) * m_step;
+        plan.scale = qMax(scale, (qreal)1.0);
+        m_desktopScale = qMax(m_desktopScale, plan.scale);
+
+        m_index.insert(output->id(), m_plans.count());
+        m_plans.append(plan);
+    }
+
+    if (m_plans.isEmpty())
+        return false;
+
+    for (int i = 0; i < m_plans.count(); ++i)
+    {
+        Plan &plan = m_plans[i];
+        qreal s = m_desktopScale / plan.scale;
+        plan.transform = RandRTransform::scale(s, s);
+        if (s == 1.0)
+            plan.transform.setFilter(RandRTransform::Nearest);
+        plan.area = QRect(QPoint(0, 0), plan.transform.mapSize(plan.mode));
+
+        qDebug() << "Scaling plan:" << plan.output->name() << plan.mode << "at"
+                 << density(plan.output, plan.mode) << "dpi, scale" << plan.scale
+                 << "shows" << plan.area.size();
+    }
+
+    arrange();
+
+    QRect bounds;
+    foreach(const Plan &plan, m_plans)
+        bounds = bounds.united(plan.area);
+    m_framebufferSize = bounds.size();
+
+    QSize max = m_screen->maxSize();
+    if (m_framebufferSize.width() > max.width() || m_framebufferSize.height() > max.height())
+    {
+        qDebug() << "Scaling plan needs a framebuffer of" << m_framebufferSize
+                 << "the screen allows" << max;
+        return false;
+    }
+
+    qDebug() << "Scaling plan: desktop scale" << m_desktopScale << "framebuffer"
+             << m_framebufferSize << "reported as" << physicalSize() << "mm";
+    return true;
+}
+
+void RandRScalingPlan::arrange()
+{
+    // keep the arrangement of the current layout: outputs touching on screen
+    // now touch in the plan, with their new sizes
+    LayoutSolver solver;
+    for (int i = 0; i < m_plans.count(); ++i)
+        solver.addNode(i, m_plans.at(i).area.size());
+
+    for (int i = 0; i < m_plans.count(); ++i)
+    {
+        QRect a = m_plans.at(i).output->rect();
+        for (int j = 0; j < m_plans.count(); ++j)
+        {
+            if (i == j)
+                continue;
+
+            QRect b = m_plans.at(j).output->rect();
+            bool rows = a.top() <= b.bottom() && b.top() <= a.bottom();
+            bool columns = a.left() <= b.right() && b.left() <= a.right();
+
+            if (a == b && i < j)
+                solver.addConstraint(j, LayoutSolver::SameAs, i);
+            else if (a.right() + 1 == b.left() && rows)
+                solver.addConstraint(j, LayoutSolver::RightOf, i);
+            else if (a.bottom() + 1 == b.top() && columns)
+                solver.addConstraint(j, LayoutSolver::Below, i);
+        }
+    }
+
+    solver.solve();
+    solver.normalize();
+
+    // groups of outputs not touching each other are placed side by side
+    QMap<int, QRect> components;
+    for (int i = 0; i < m_plans.count(); ++i)
+    {
+        int c = solver.component(i);
+        components[c] = components.value(c).united(solver.rect(i));
+    }
+
+    QMap<int, QPoint> offsets;
+    int x = 0;
+    QMap<int, QRect>::const_iterator it;
+    for (it = components.constBegin(); it != components.constEnd(); ++it)
+    {
+        offsets.insert(it.key(), QPoint(x - it.value().left(), -it.value().top()));
+        x += it.value().width();
+    }
+
+    for (int i = 0; i < m_plans.count(); ++i)
+        m_plans[i].area = solver.rect(i).translated(offsets.value(solver.component(i)));
+}
+
+void RandRScalingPlan::propose()
+{
+    foreach(const Plan &plan, m_plans)
+    {
+        plan.output->proposeRect(QRect(plan.area.topLeft(), plan.mode));
+        plan.output->proposeTransform(plan.transform);
+        plan.output->proposeVirtualModeEnabled(false);
+    }
+    m_screen->proposeDpi(dpi());
+}
+
+qreal RandRScalingPlan::outputScale(RROutput output) const
+{
+    if (!m_index.contains(output))
+        return 1.0;
+    return m_plans.at(m_index.value(output)).scale;
+}
+
+qreal RandRScalingPlan::desktopScale() const
+{
+    return m_desktopScale;
+}
+
+RandRTransform RandRScalingPlan::transform(RROutput output) const
+{
+    if (!m_index.contains(output))
+        return RandRTransform();
+    return m_plans.at(m_index.value(output)).transform;
+}
+
+QRect RandRScalingPlan::area(RROutput output) const
+{
+    if (!m_index.contains(output))
+        return QRect();
+    return m_plans.at(m_index.value(output)).area;
+}
+
+QSize RandRScalingPlan::framebufferSize() const
+{
+    return m_framebufferSize;
+}
+
+qreal RandRScalingPlan::dpi() const
+{
+    return m_referenceDpi * m_desktopScale;
+}
+
+QSize RandRScalingPlan::physicalSize() const
+{
+    return QSize(qRound(25.4 * m_framebufferSize.width() / dpi()),
+                 qRound(25.4 * m_framebufferSize.height() / dpi()));
+}
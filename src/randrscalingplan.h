@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRSCALINGPLAN_H
+#define RANDRSCALINGPLAN_H
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+
+#include "randr.h"
+#include "randrtransform.h"
+
+/** Plans per-output scaling for layouts mixing displays of different
+ * pixel densities.
+ *
+ * The density of every output is computed from its mode and the physical
+ * size in its EDID, and rounded to a multiple of the scale step. The
+ * desktop is rendered for the densest output; every other output gets a
+ * scaling transform that shows a correspondingly larger area of the
+ * framebuffer, so that things have the same physical size everywhere.
+ * Outputs keep the arrangement they have now. The plan gives the
+ * framebuffer size, the transform of every output and the DPI to report,
+ * and is proposed to the screen as one layout. */
+class RandRScalingPlan
+{
+public:
+    RandRScalingPlan(RandRScreen *screen);
+
+    /** DPI that corresponds to a scale of 1, 96 by default. */
+    void setReferenceDpi(qreal dpi);
+
+    /** Scale factors are rounded to multiples of @p step, 0.25 by default. */
+    void setScaleStep(qreal step);
+
+    /** Plans the active outputs with their proposed modes. Returns false
+     * if there is nothing to scale or the framebuffer would be too big. */
+    bool compute();
+
+    void propose();
+
+    /** Scale factor of an output's density relative to the reference. */
+    qreal outputScale(RROutput output) const;
+
+    /** Scale the desktop is rendered at, the largest output scale. */
+    qreal desktopScale() const;
+
+    RandRTransform transform(RROutput output) const;
+    QRect area(RROutput output) const;
+
+    QSize framebufferSize() const;
+    QSize physicalSize() const;
+    qreal dpi() const;
+
+private:
+    struct Plan
+    {
+        RandROutput *output;
+        QSize mode;
+        qreal scale;
+        RandRTransform transform;
+        QRect area;
+    };
+
+    qreal density(RandROutput *output, const QSize &mode) const;
+    void arrange();
+
+    RandRScreen *m_screen;
+    qreal m_referenceDpi;
+    qreal m_step;
+
+    QList<Plan> m_plans;
+    QMap<RROutput,int> m_index;
+    qreal m_desktopScale;
+    QSize m_framebufferSize;
+};
+
+#endif // RANDRSCALINGPLAN_H
@@ -17,20 +17,32 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-#include <QtCore/QSettings>
 #include <QtGui/QAction>
 
 #include "randrscreen.h"
+#include "settingswriter.h"
+#include "randrconfigstore.h"
 #include "randrcrtc.h"
 #include "randroutput.h"
 #include "randrmode.h"
+#include "randrcrtcallocator.h"
+#include "randrbenchmark.h"
 #include <X11/extensions/Xrandr.h>
 
-RandRScreen::RandRScreen(int screenIndex)
-: m_originalPrimaryOutput(0),
+RandRScreen::RandRScreen(int screenIndex, const RandRCapabilities &capabilities)
+: m_capabilities(capabilities),
+  m_originalPrimaryOutput(0),
   m_proposedPrimaryOutput(0),
-  m_resources(0)
+  m_primaryOutput(0),
+  m_primaryOutputValid(false),
+  m_resources(0),
+  m_timestamp(CurrentTime),
+  m_configTimestamp(CurrentTime),
+  m_generation(0)
 {
+    m_dpi = 0;
+    m_dpiPending = false;
+    m_settingsWriter = new SettingsWriter(this);
     m_index = screenIndex;
     m_rect = QRect(0, 0, XDisplayWidth(QX11Info::display(), m_index),
                  XDisplayHeight(QX11Info::display(), m_index));
@@ -39,8 +51,9 @@ RandRScreen::RandRScreen(int screenIndex)
     m_activeCount = 0;
 
     loadSettings();
-    QSettings cfg;
-    load(cfg, true);
+    RandRConfigStore store;
+    store.open();
+    load(store, true);
 
     m_originalPrimaryOutput = primaryOutput();
 
@@ -56,6 +69,9 @@ RandRScreen::RandRScreen(int screenIndex)
 
 RandRScreen::~RandRScreen()
 {
+    // write pending settings while the outputs are still there
+    m_settingsWriter->flush();
+
     if (m_resources)
         XRRFreeScreenResources(m_resources);
 
@@ -69,6 +85,11 @@ int RandRScreen::index() const
     return m_index;
 }
 
+const RandRCapabilities &RandRScreen::capabilities() const
+{
+    return m_capabilities;
+}
+
 XRRScreenResources* RandRScreen::resources() const
 {
     return m_resources;
@@ -81,90 +102,243 @@ Window RandRScreen::rootWindow() const
 
 void RandRScreen::loadSettings(bool notify)
 {
-    bool changed = false;
-    int minW, minH, maxW, maxH;
+    RandRBenchmark::Phase phase("RandRScreen::loadSettings");
+    Time timestamp, configTimestamp;
+    timestamp = XRRTimes(QX11Info::display(), m_index, &configTimestamp);
+
+    // nothing happened on the server since the resources were fetched
+    if (m_resources && timestamp == m_timestamp && configTimestamp == m_configTimestamp)
+    {
+        qDebug() << "Screen" << m_index << "is up to date, skipping refresh";
+        return;
+    }
 
-    Status status = XRRGetScreenSizeRange(QX11Info::display(), rootWindow(),
-                     &minW, &minH, &maxW, &maxH);
-    //FIXME: we should check the status here
-    Q_UNUSED(status);
-    QSize minSize = QSize(minW, minH);
-    QSize maxSize = QSize(maxW, maxH);
+    // a new config timestamp means outputs or modes may have come and gone,
+    // otherwise only the CRTC configuration can have changed
+    bool configChanged = !m_resources || configTimestamp != m_configTimestamp;
+    bool changed = false;
 
-    if (minSize != m_minSize || maxSize != m_maxSize)
+    if (configChanged)
     {
-        m_minSize = minSize;
-        m_maxSize = maxSize;
-        changed = true;
+        int minW, minH, maxW, maxH;
+
+        Status status = XRRGetScreenSizeRange(QX11Info::display(), rootWindow(),
+                         &minW, &minH, &maxW, &maxH);
+        //FIXME: we should check the status here
+        Q_UNUSED(status);
+        QSize minSize = QSize(minW, minH);
+        QSize maxSize = QSize(maxW, maxH);
+
+        if (minSize != m_minSize || maxSize != m_maxSize)
+        {
+            m_minSize = minSize;
+            m_maxSize = maxSize;
+            changed = true;
+        }
     }
 
     if (m_resources)
         XRRFreeScreenResources(m_resources);
 
-    m_resources = XRRGetScreenResources(QX11Info::display(), rootWindow());
+#ifdef HAS_RANDR_1_3
+    // only probe the outputs again if the configuration itself changed; the
+    // dialog leaves probing to the worker
+    if (RandR::has_1_3 && (!configChanged || RandR::probe_async))
+        m_resources = XRRGetScreenResourcesCurrent(QX11Info::display(), rootWindow());
+    else
+#endif
+        m_resources = XRRGetScreenResources(QX11Info::display(), rootWindow());
     Q_ASSERT(m_resources);
 
     RandR::timestamp = m_resources->timestamp;
+    m_timestamp = timestamp;
+    m_configTimestamp = configTimestamp;
+    ++m_generation;
 
-    // get all modes
-    for (int i = 0; i < m_resources->nmode; ++i)
+    // get all modes, dropping the ones the server no longer knows about
+    if (configChanged)
     {
-        if (!m_modes.contains(m_resources->modes[i].id))
+        ModeMap modes;
+        for (int i = 0; i < m_resources->nmode; ++i)
         {
-            m_modes[m_resources->modes[i].id] = RandRMode(&m_resources->modes[i]);
-            changed = true;
+            if (!m_modes.contains(m_resources->modes[i].id))
+                changed = true;
+            modes[m_resources->modes[i].id] = RandRMode(&m_resources->modes[i]);
         }
+        if (modes.count() != m_modes.count())
+            changed = true;
+        m_modes = modes;
     }
 
     //get all crtcs
-    qDebug() << "Creating CRTC object for XID 0 (\"None\")";
-    RandRCrtc *c_none = new RandRCrtc(this, None);
-    m_crtcs[None] = c_none;
+    if (!m_crtcs.contains(None))
+    {
+        qDebug() << "Creating CRTC object for XID 0 (\"None\")";
+        m_crtcs[None] = new RandRCrtc(this, None);
+    }
+    m_crtcs[None]->setGeneration(m_generation);
 
     for (int i = 0; i < m_resources->ncrtc; ++i)
     {
-        if (m_crtcs.contains(m_resources->crtcs[i]))
-            m_crtcs[m_resources->crtcs[i]]->loadSettings(notify);
+        RandRCrtc *c = m_crtcs.value(m_resources->crtcs[i]);
+        if (c)
+            c->loadSettings(notify);
         else
         {
             qDebug() << "Creating CRTC object for XID" << m_resources->crtcs[i];
-            RandRCrtc *c = new RandRCrtc(this, m_resources->crtcs[i]);
+            c = new RandRCrtc(this, m_resources->crtcs[i]);
             connect(c, SIGNAL(crtcChanged(RRCrtc,int)), this, SIGNAL(configChanged()));
-            connect(c, SIGNAL(crtcChanged(RRCrtc,int)), this, SLOT(save()));
+            connect(c, SIGNAL(crtcChanged(RRCrtc,int)), m_settingsWriter, SLOT(markDirty()));
             c->loadSettings(notify);
             m_crtcs[m_resources->crtcs[i]] = c;
             changed = true;
         }
+        c->setGeneration(m_generation);
+    }
+
+    // map every output to the CRTC now driving it, so that only outputs
+    // whose CRTC moved have to be queried again
+    QMap<RROutput,RRCrtc> outputCrtcs;
+    foreach(RandRCrtc *c, m_crtcs)
+    {
+        if (c->generation() != m_generation)
+            continue;
+        foreach(RROutput o, c->connectedOutputs())
+            outputCrtcs[o] = c->id();
     }
 
     //get all outputs
     for (int i = 0; i < m_resources->noutput; ++i)
     {
-        if (m_outputs.contains(m_resources->outputs[i]))
-            ;//m_outputs[m_resources->outputs[i]]->loadSettings(notify);
+        RandROutput *o = m_outputs.value(m_resources->outputs[i]);
+        if (o)
+        {
+            if (configChanged || !o->crtc() || outputCrtcs.value(o->id(), None) != o->crtc()->id())
+                o->loadSettings(notify);
+        }
         else
         {
             qDebug() << "Creating output object for XID" << m_resources->outputs[i];
-            RandROutput *o = new RandROutput(this, m_resources->outputs[i]);
+            o = new RandROutput(this, m_resources->outputs[i]);
             connect(o, SIGNAL(outputChanged(RROutput,int)), this,
                       SLOT(slotOutputChanged(RROutput,int)));
             m_outputs[m_resources->outputs[i]] = o;
-            if (o->isConnected())
-                m_connectedCount++;
-            if (o->isActive())
-                m_activeCount++;
-
             changed = true;
         }
+        o->setGeneration(m_generation);
     }
 
+    if (configChanged)
+        changed |= reclaimStale();
+
+    updateCounts();
+
     if (notify && changed)
         emit configChanged();
 
 }
 
+bool RandRScreen::needsRefresh() const
+{
+    Time timestamp, configTimestamp;
+    timestamp = XRRTimes(QX11Info::display(), m_index, &configTimestamp);
+
+    return (!m_resources || timestamp != m_timestamp || configTimestamp != m_configTimestamp);
+}
+
+bool RandRScreen::needsRefresh(Time timestamp, Time configTimestamp) const
+{
+    return (!m_resources || timestamp != m_resources->timestamp
+            || configTimestamp != m_resources->configTimestamp);
+}
+
+void RandRScreen::invalidate(bool config)
+{
+    m_timestamp = CurrentTime;
+    if (config)
+        m_configTimestamp = CurrentTime;
+}
+
+uint RandRScreen::generation() const
+{
+    return m_generation;
+}
+
+bool RandRScreen::reclaimStale()
+{
+    bool changed = false;
+    bool outputsGone = false;
+
+    // outputs first, as they hold references to their CRTCs
+    OutputMap::iterator o = m_outputs.begin();
+    while (o != m_outputs.end())
+    {
+        RandROutput *output = o.value();
+        if (output->generation() == m_generation)
+        {
+            // make sure nobody keeps using a CRTC that is about to go away
+            if (output->crtc() && output->crtc()->generation() != m_generation)
+                output->disconnectFromCrtc();
+            ++o;
+            continue;
+        }
+
+        qDebug() << "Reclaiming stale output object for XID" << o.key();
+        output->disconnectFromCrtc();
+        if (m_primaryOutput == output)
+            m_primaryOutputValid = false;
+        if (m_proposedPrimaryOutput == output)
+            m_proposedPrimaryOutput = 0;
+        if (m_originalPrimaryOutput == output)
+            m_originalPrimaryOutput = 0;
+        output->deleteLater();
+        o = m_outputs.erase(o);
+        changed = outputsGone = true;
+    }
+
+    CrtcMap::iterator c = m_crtcs.begin();
+    while (c != m_crtcs.end())
+    {
+        if (c.value()->generation() == m_generation)
+        {
+            ++c;
+            continue;
+        }
+
+        qDebug() << "Reclaiming stale CRTC object for XID" << c.key();
+        c.value()->deleteLater();
+        c = m_crtcs.erase(c);
+        changed = true;
+    }
+
+    if (outputsGone)
+        emit outputsReclaimed();
+    return changed;
+}
+
+void RandRScreen::updateCounts()
+{
+    int connected = 0, active = 0;
+    foreach(RandROutput *output, m_outputs)
+    {
+        if (output->isConnected())
+            connected++;
+        if (output->isActive())
+            active++;
+    }
+
+    m_connectedCount = connected;
+    m_activeCount = active;
+}
+
 void RandRScreen::handleEvent(XRRScreenChangeNotifyEvent* event)
 {
+    // keep Xlib's cached timestamps, used by needsRefresh(), up to date
+    XRRUpdateConfiguration((XEvent*)event);
+
+    // the primary output may have been changed by someone else
+    m_primaryOutputValid = false;
+
     m_rect.setWidth(event->width);
     m_rect.setHeight(event->height);
 
@@ -179,26 +353,32 @@ void RandRScreen::handleRandREvent(XRRNotifyEvent* event)
     XRROutputChangeNotifyEvent *outputEvent;
     XRROutputPropertyNotifyEvent *propertyEvent;
 
-    // forward events to crtcs and outputs
+    // forward events to crtcs and outputs; ones the cached resources do
+    // not know yet are picked up by the next refresh
     switch (event->subtype) {
         case RRNotify_CrtcChange:
             crtcEvent = (XRRCrtcChangeNotifyEvent*)event;
             c = crtc(crtcEvent->crtc);
-            Q_ASSERT(c);
+            if (!c)
+                return;
             c->handleEvent(crtcEvent);
             return;
 
         case RRNotify_OutputChange:
             outputEvent = (XRROutputChangeNotifyEvent*)event;
             o = output(outputEvent->output);
-            Q_ASSERT(o);
+            if (!o)
+                return;
+            if (o == m_primaryOutput)
+                m_primaryOutputValid = false;
             o->handleEvent(outputEvent);
             return;
 
         case RRNotify_OutputProperty:
             propertyEvent = (XRROutputPropertyNotifyEvent*)event;
             o = output(propertyEvent->output);
-            Q_ASSERT(o);
+            if (!o)
+                return;
             o->handlePropertyEvent(propertyEvent);
             return;
     }
@@ -242,12 +422,17 @@ RandROutput* RandRScreen::output(RROutput id) const
 
 void RandRScreen::setPrimaryOutput(RandROutput* output)
 {
-    if (RandR::has_1_3)
+    if (m_capabilities.primary)
     {
+        if (m_primaryOutputValid && m_primaryOutput == output)
+            return;
+
         RROutput id = None;
         if (output)
             id = output->id();
         XRRSetOutputPrimary(QX11Info::display(), rootWindow(), id);
+        m_primaryOutput = output;
+        m_primaryOutputValid = true;
     }
 }
 
@@ -258,9 +443,14 @@ void RandRScreen::proposePrimaryOutput(RandROutput* output)
 
 RandROutput* RandRScreen::primaryOutput()
 {
-    if (RandR::has_1_3)
+    if (m_capabilities.primary)
     {
-        return output(XRRGetOutputPrimary(QX11Info::display(), rootWindow()));
+        if (!m_primaryOutputValid)
+        {
+            m_primaryOutput = output(XRRGetOutputPrimary(QX11Info::display(), rootWindow()));
+            m_primaryOutputValid = true;
+        }
+        return m_primaryOutput;
     }
     return 0;
 }
@@ -309,9 +499,15 @@ bool RandRScreen::adjustSize(const QRect &minimumSize)
     return setSize(rect.size());
 }
 
+void RandRScreen::proposeDpi(qreal dpi)
+{
+    m_dpi = dpi;
+    m_dpiPending = true;
+}
+
 bool RandRScreen::setSize(const QSize &s)
 {
-    if (s == m_rect.size())
+    if (s == m_rect.size() && !m_dpiPending)
         return true;
 
     if (s.width() < m_minSize.width() ||
@@ -324,12 +520,18 @@ bool RandRScreen::setSize(const QSize &s)
     float dpi;
 
     /* values taken from xrandr */
-    dpi = (25.4 * DisplayHeight(QX11Info::display(), m_index)) / DisplayHeightMM(QX11Info::display(), m_index);
+    if (m_dpi > 0)
+        dpi = m_dpi;
+    else
+        dpi = (25.4 * DisplayHeight(QX11Info::display(), m_index)) / DisplayHeightMM(QX11Info::display(), m_index);
     widthMM =  (int) ((25.4 * s.width()) / dpi);
     heightMM = (int) ((25.4 * s.height()) / dpi);
 
     XRRSetScreenSize(QX11Info::display(), rootWindow(), s.width(), s.height(), widthMM, heightMM);
     m_rect.setSize(s);
+    // a proposed DPI only holds for the layout it came with
+    m_dpi = 0;
+    m_dpiPending = false;
     
     qDebug() << "[RandRScreen::setSize] width=" << s.width() << "height=" << s.height() << "widthMM=" << widthMM << "heightMM=" << heightMM;
      
@@ -420,15 +622,35 @@ QRect RandRScreen::rect() const
     return m_rect;
 }
 
-void RandRScreen::load(QSettings &config, bool skipOutputs)
+bool RandRScreen::selectProfile(RandRConfigStore &store) const
+{
+    QStringList connectors, serials;
+    foreach(RandROutput *output, m_outputs)
+    {
+        if (!output->isConnected())
+            continue;
+        connectors << output->name();
+        serials << output->edidSerial();
+    }
+
+    bool exact = store.selectProfile(m_index, connectors, serials);
+    qDebug() << "Settings profile for screen" << m_index << ":" << store.profile()
+             << (exact ? "(exact)" : "(closest)");
+    return exact;
+}
+
+void RandRScreen::load(RandRConfigStore &store, bool skipOutputs)
 {
-    config.beginGroup("Screen_" + QString::number(m_index));
-    m_outputsUnified = config.value("OutputsUnified", false).toBool();
-    m_unifiedRect = ((config.value("UnifiedRect", "0,0,0,0") == QVariant("0,0,0,0"))
-        ? QRect() : config.value("UnifiedRect", QRect())).toRect();
-            m_unifiedRotation = config.value("UnifiedRotation", (int) RandR::Rotate0).toInt();
+    selectProfile(store);
+    // a profile that is loaded counts as used, so that it is not the one
+    // dropped when the store is full
+    if (store.touchProfile())
+        store.write();
 
-    config.endGroup();
+    RandRConfigStore::ScreenRecord record = store.screen(m_index);
+    m_outputsUnified = record.flags & RandRConfigStore::OutputsUnified;
+    m_unifiedRect = RandRConfigStore::rect(record.unifiedRect);
+    m_unifiedRotation = record.unifiedRotation;
 
     if (skipOutputs)
         return;
@@ -436,31 +658,35 @@ void RandRScreen::load(QSettings &config, bool skipOutputs)
     foreach(RandROutput *output, m_outputs)
     {
         if (output->isConnected())
-            output->load(config);
+            output->load(store);
     }
 }
 
-void RandRScreen::save(QSettings &config)
+void RandRScreen::save(RandRConfigStore &store)
 {
-    config.beginGroup("Screen_" + QString::number(m_index));
-    config.setValue("OutputsUnified", m_outputsUnified);
-    config.setValue("OutputsUnified", m_outputsUnified);
-    config.setValue("UnifiedRect", m_unifiedRect);
-    config.setValue("UnifiedRotation", m_unifiedRotation);
+    selectProfile(store);
 
-    config.endGroup();
+    RandRConfigStore::ScreenRecord record = store.screen(m_index);
+    record.flags = m_outputsUnified ? RandRConfigStore::OutputsUnified : 0;
+    RandRConfigStore::setRect(record.unifiedRect, m_unifiedRect);
+    record.unifiedRotation = m_unifiedRotation;
+    store.setScreen(record);
 
     foreach(RandROutput *output, m_outputs)
     {
         if (output->isConnected())
-            output->save(config);
+            output->save(store);
     }
 }
 
 void RandRScreen::save()
 {
-    QSettings config;
-    save(config);
+    m_settingsWriter->markDirty();
+}
+
+bool RandRScreen::flushSettings()
+{
+    return m_settingsWriter->flush();
 }
 
 QStringList RandRScreen::startupCommands() const
@@ -476,8 +702,9 @@ QStringList RandRScreen::startupCommands() const
 
 void RandRScreen::load()
 {
-    QSettings config;
-    load(config);
+    RandRConfigStore store;
+    store.open();
+    load(store);
 }
 
 bool RandRScreen::applyProposed(bool confirm)
@@ -487,6 +714,25 @@ bool RandRScreen::applyProposed(bool confirm)
     bool succeed = true;
     QRect r;
 
+    // check the whole layout locally first, nothing has been changed yet
+    // so there is nothing to revert if it cannot work
+    RandRLayoutValidator validator(this);
+    if (!validator.validate())
+    {
+        m_layoutErrors = validator.errors();
+        foreach(const RandRLayoutError &error, m_layoutErrors)
+            qDebug() << "Invalid layout:" << error.message();
+        return false;
+    }
+    m_layoutErrors.clear();
+
+    // nothing has been sent to the server yet, the outputs to turn off are
+    // only proposed to be; from here on everything can be rolled back
+    m_journal.record(this);
+
+    // the validator has planned the CRTCs already
+    assignCrtcs(validator.assignment());
+
     foreach(RandROutput *output, m_outputs) {
         /*
         r = output->rect();
@@ -547,26 +793,250 @@ bool RandRScreen::applyProposed(bool confirm)
     // if we succeeded applying and the user confirmed the changes,
     // just return from here
     if (succeed)
+    {
+        m_journal.clear();
         return true;
+    }
 
     qDebug() << "Changes canceled, reverting to original setup.";
+    revert();
+    return false;
+}
+
+void RandRScreen::revert()
+{
+    // write the recorded configuration back in one go instead of applying
+    // every output again
+    m_journal.replay();
+
+    // the primary output is the one the journal has just set again
+    m_primaryOutput = output(m_journal.primary());
+    m_proposedPrimaryOutput = m_primaryOutput;
+    m_primaryOutputValid = true;
+    m_journal.clear();
+
+    // pick up the restored CRTC configuration
+    invalidate(false);
+    loadSettings(true);
+}
+
+// connected outputs that still drive a CRTC but are proposed to be turned off
+static bool isBeingDisabled(RandROutput *o)
+{
+    return o->isConnected() && o->crtc() && o->crtc()->isValid() && !o->proposedRect().isValid();
+}
+
+bool RandRScreen::planCrtcs(QMap<RROutput,RRCrtc> &assignment) const
+{
+    RandRCrtcAllocator allocator;
+    QList<RandROutput*> layout = layoutOutputs();
+
+    foreach(RandROutput *o, layout)
+        allocator.addOutput(o->id(), o->possibleCrtcs(), o->crtc()->id());
+
+    // CRTCs still driving outputs outside of the layout are off limits
+    foreach(RandRCrtc *c, m_crtcs)
+    {
+        foreach(RROutput id, c->connectedOutputs())
+        {
+            RandROutput *o = output(id);
+            // the CRTCs of outputs being turned off are free for the others
+            if (!o || (layout.indexOf(o) == -1 && !isBeingDisabled(o)))
+            {
+                allocator.reserveCrtc(c->id());
+                break;
+            }
+        }
+    }
+
+    bool complete = allocator.solve();
+    assignment = allocator.assignment();
+    if (complete)
+        return true;
+
+    // the remaining outputs can still share a CRTC with an identical clone
+    bool shared = true;
+    foreach(RROutput id, allocator.unassigned())
+    {
+        RandROutput *o = output(id);
+        RRCrtc clone = None;
+        foreach(RandROutput *other, layout)
+        {
+            RRCrtc c = allocator.crtc(other->id());
+            if (c != None && o->possibleCrtcs().indexOf(c) != -1
+                && other->proposedRect() == o->proposedRect()
+                && other->proposedRotation() == o->proposedRotation()
+                && other->proposedTransform() == o->proposedTransform())
+            {
+                clone = c;
+                break;
+            }
+        }
+
+        if (clone == None)
+        {
+            qDebug() << "No CRTC left for output" << o->name();
+            shared = false;
+            continue;
+        }
+        assignment[id] = clone;
+    }
+    return shared;
+}
 
-    //Revert changes if not succeed
+QList<RandROutput*> RandRScreen::layoutOutputs() const
+{
+    QList<RandROutput*> layout;
+    foreach(RandROutput *o, m_outputs)
+    {
+        if (!o->isConnected() || !o->crtc())
+            continue;
+        // outputs that are or will be disabled do not need a CRTC
+        if (!o->proposedRect().isValid())
+            continue;
+        layout.append(o);
+    }
+    return layout;
+}
+
+void RandRScreen::assignCrtcs(const QMap<RROutput,RRCrtc> &assignment)
+{
+    CrtcList used;
+    foreach(RandRCrtc *c, m_crtcs)
+    {
+        if (c->isValid() && !c->connectedOutputs().isEmpty())
+            used.append(c->id());
+    }
+
+    // let go of the CRTCs of outputs being turned off, so that they can be
+    // handed to others; left empty, they are released below
     foreach(RandROutput *o, m_outputs)
     {
-        if (o->isConnected())
+        if (isBeingDisabled(o))
+            o->disconnectFromCrtc();
+    }
+
+    foreach(RandROutput *o, layoutOutputs())
+    {
+        RandRCrtc *c = crtc(assignment.value(o->id()));
+        if (c && c->isValid() && c != o->crtc())
         {
-            o->proposeOriginal();
-            o->applyProposed();
+            qDebug() << "Assigning CRTC" << c->id() << "to output" << o->name();
+            o->assignCrtc(c);
         }
     }
 
-    m_proposedPrimaryOutput = m_originalPrimaryOutput;
-    setPrimaryOutput(m_proposedPrimaryOutput);
-    return false;
+    // release the CRTCs that were left without outputs before the others
+    // get their new configuration
+    foreach(RRCrtc id, used)
+    {
+        RandRCrtc *c = crtc(id);
+        if (c->connectedOutputs().isEmpty())
+            c->applyProposed();
+    }
+}
+
+LayoutErrorList RandRScreen::layoutErrors() const
+{
+    return m_layoutErrors;
+}
+
+static QSize nativeSize(RandROutput *output)
+{
+    if (output->preferredMode().isValid())
+        return output->preferredMode().size();
+
+    // no preferred mode, take the largest one
+    QSize size(0, 0);
+    foreach(const QSize &s, output->sizes())
+    {
+        if (s.width() * s.height() > size.width() * size.height())
+            size = s;
+    }
+    return size;
+}
+
+QSize RandRScreen::cloneSize()
+{
+    // keep the primary output, usually the one the presenter looks at, at
+    // its native size
+#ifdef HAS_RANDR_1_3
+    RandROutput *primary = RandR::has_1_3 ? primaryOutput() : 0;
+    if (primary && primary->isConnected() && !nativeSize(primary).isEmpty())
+        return nativeSize(primary);
+#endif
+
+    QSize size(0, 0);
+    foreach(RandROutput *output, m_outputs)
+    {
+        if (!output->isConnected())
+            continue;
+
+        QSize native = nativeSize(output);
+        if (native.width() * native.height() > size.width() * size.height())
+            size = native;
+    }
+    return size;
 }
 
 void RandRScreen::unifyOutputs()
+{
+    // if there is only one output connected, there is no way to unify it
+    if (m_connectedCount <= 1)
+        return;
+
+    // without transforms all outputs have to run a mode they have in common
+    if (!m_capabilities.transform)
+    {
+        unifyOutputsCommonSize();
+        return;
+    }
+
+    if (m_unifiedRect.isEmpty())
+        m_unifiedRect = QRect(QPoint(0, 0), cloneSize());
+    if (m_unifiedRect.isEmpty())
+        return;
+
+    qDebug() << "Cloning outputs at their native modes onto" << m_unifiedRect;
+
+    // every output keeps its native mode, so projectors don't have to switch
+    // modes; the CRTC transform scales the shared area onto each of them,
+    // the same in both directions, and centers it on outputs of another
+    // aspect ratio
+    const int sideways = RandR::Rotate90 | RandR::Rotate270;
+    foreach(RandROutput *o, m_outputs)
+    {
+        if (!o->isConnected())
+            continue;
+
+        QSize native = nativeSize(o);
+        if (native.isEmpty())
+            continue;
+
+        QSize rotated = (m_unifiedRotation & sideways) ? QSize(native.height(), native.width()) : native;
+        qreal scale = qMax((qreal)m_unifiedRect.width() / rotated.width(),
+                           (qreal)m_unifiedRect.height() / rotated.height());
+        qreal dx = (m_unifiedRect.width() - rotated.width() * scale) / 2;
+        qreal dy = (m_unifiedRect.height() - rotated.height() * scale) / 2;
+
+        o->proposeRect(QRect(m_unifiedRect.topLeft(), native));
+        o->proposeRotation(m_unifiedRotation);
+        o->proposeTransform(RandRTransform::translation(dx, dy) * RandRTransform::scale(scale, scale));
+    }
+
+    // all clones go to the server as one layout, which is rolled back as a
+    // whole if one of them fails
+#ifdef HAS_RANDR_1_3
+    proposePrimaryOutput(primaryOutput());
+#endif
+    if (!applyProposed(false))
+        return;
+
+    save();
+    emit configChanged();
+}
+
+void RandRScreen::unifyOutputsCommonSize()
 {
 //    KConfig cfg("krandrrc");
     SizeList sizes = unifiedSizes();
@@ -575,10 +1045,6 @@ void RandRScreen::unifyOutputs()
     if (!sizes.count())
         return;
 
-    // if there is only one output connected, there is no way to unify it
-    if (m_connectedCount <= 1)
-        return;
-
     if (sizes.indexOf(m_unifiedRect.size()) == -1)
         m_unifiedRect.setSize(sizes.first());
 
@@ -601,7 +1067,8 @@ void RandRScreen::unifyOutputs()
         //o->load(cfg);
         o->proposeRect(m_unifiedRect);
         o->proposeRotation(m_unifiedRotation);
-        o->applyProposed(RandR::ChangeRect | RandR::ChangeRotation, false);
+        o->proposeScale(QSizeF(1.0, 1.0));
+        o->applyProposed(RandR::ChangeRect | RandR::ChangeRotation | RandR::ChangeTransform, false);
     }
 
     // FIXME: if by any reason we were not able to unify the outputs, we should
@@ -619,17 +1086,26 @@ void RandRScreen::slotResizeUnified(QAction *action)
 void RandRScreen::slotUnifyOutputs(bool unified)
 {
     m_outputsUnified = unified;
-    QSettings cfg;
+    RandRConfigStore store;
+    store.open();
+    selectProfile(store);
 
     if (!unified || m_connectedCount <= 1)
     {
         foreach(RandROutput *output, m_outputs)
             if (output->isConnected())
             {
-                output->load(cfg);
+                output->load(store);
                 output->applyProposed();
             }
     }
+    else if (m_capabilities.transform)
+    {
+        // outputs are scaled, so the shared area doesn't have to be a mode
+        // all of them support
+        m_unifiedRect = QRect(QPoint(0, 0), cloneSize());
+        unifyOutputs();
+    }
     else
     {
         SizeList sizes = unifiedSizes();
@@ -658,19 +1134,9 @@ void RandRScreen::slotOutputChanged(RROutput id, int changes)
     Q_UNUSED(id);
     Q_UNUSED(changes);
 
-    int connected = 0, active = 0;
-    foreach(RandROutput *output, m_outputs)
-    {
-        if (output->isConnected())
-            connected++;
-        if (output->isActive())
-            active++;
-    }
-
-    m_connectedCount = connected;
-    m_activeCount = active;
+    updateCounts();
 
     // if there is less than 2 outputs connected, there is no need to unify
-    if (connected <= 1)
+    if (m_connectedCount <= 1)
         return;
 }
@@ -21,23 +21,27 @@
 #define RANDRSCREEN_H
 
 #include "randr.h"
+#include "randrlayoutvalidator.h"
+#include "randrjournal.h"
 #include <QtGui/QX11Info>
 #include <QtCore/QObject>
 #include <QtCore/QMap>
 
 class QSize;
 class QAction;
-class QSettings;
+class RandRConfigStore;
+class SettingsWriter;
 
 class RandRScreen : public QObject
 {
     Q_OBJECT
 
 public:
-    RandRScreen(int screenIndex);
+    RandRScreen(int screenIndex, const RandRCapabilities &capabilities);
     ~RandRScreen();
 
     int index() const;
+    const RandRCapabilities &capabilities() const;
 
     XRRScreenResources* resources() const;
     Window rootWindow() const;
@@ -47,6 +51,24 @@ public:
 
     void loadSettings(bool notify = false);
 
+    /** Returns true if the server or config timestamps moved past the ones
+     * the cached resources were fetched at. */
+    bool needsRefresh() const;
+    /** Returns true if the cached resources are older than the given
+     * server timestamps, e.g. ones seen on another connection. Unlike
+     * needsRefresh() this does not depend on Xlib having processed the
+     * RandR events yet. */
+    bool needsRefresh(Time timestamp, Time configTimestamp) const;
+
+    /** Forgets the cached timestamps so that the next loadSettings()
+     * refetches everything, e.g. after RRSetConfigInvalidConfigTime.
+     * If @p config is false only the CRTC configuration is reloaded. */
+    void invalidate(bool config = true);
+
+    /** Generation of the last refresh that refetched resources. CRTCs and
+     * outputs not seen in the current generation are stale. */
+    uint generation() const;
+
     void handleEvent(XRRScreenChangeNotifyEvent* event);
     void handleRandREvent(XRRNotifyEvent* event);
 
@@ -69,6 +91,10 @@ public:
     bool adjustSize(const QRect &minimumSize = QRect(0,0,0,0));
     bool setSize(const QSize &s);
 
+    /** DPI to report with the next framebuffer size. By default the DPI
+     * of the current screen is kept. */
+    void proposeDpi(qreal dpi);
+
     /**
      * Return the number of connected outputs
      */
@@ -89,8 +115,32 @@ public:
 
     bool applyProposed(bool confirm);
 
-    void load(QSettings &config, bool skipOutputs = false);
-    void save(QSettings  &config);
+    /** Hands out the CRTCs of @p assignment, as planned by planCrtcs(), to
+     * all outputs of the proposed layout at once. Outputs being turned off
+     * let go of their CRTCs, and the CRTCs left without outputs are turned
+     * off on the server right away. */
+    void assignCrtcs(const QMap<RROutput,RRCrtc> &assignment);
+
+    /** Computes the CRTC assignment for the proposed layout, without
+     * changing anything. Returns false if the layout needs more CRTCs than
+     * the outputs can get. */
+    bool planCrtcs(QMap<RROutput,RRCrtc> &assignment) const;
+
+    /** Connected outputs that are part of the proposed layout. */
+    QList<RandROutput*> layoutOutputs() const;
+
+    /** Errors found by the last pre-flight check of applyProposed(). */
+    LayoutErrorList layoutErrors() const;
+
+    /** Selects the profile of the currently connected displays in
+     * @p store. load() and save() do this themselves. */
+    bool selectProfile(RandRConfigStore &store) const;
+
+    void load(RandRConfigStore &store, bool skipOutputs = false);
+    void save(RandRConfigStore &store);
+
+    /** Writes settings marked by save() right away. */
+    bool flushSettings();
     QStringList startupCommands() const;
 
 public slots:
@@ -100,20 +150,40 @@ public slots:
 
     void slotOutputChanged(RROutput id, int changes);
 
+    /** Marks the settings dirty; they are written once changes settle. */
     void save();
     void load();
 
 signals:
     void configChanged();
+    /** Stale outputs were dropped; they are deleted once control returns
+     * to the event loop, so anything pointing at them must let go before. */
+    void outputsReclaimed();
 
 protected slots:
     void unifyOutputs();
 
 private:
+    void unifyOutputsCommonSize();
+
+    /** Size of the area shown on all outputs when they are cloned with
+     * scaling transforms. */
+    QSize cloneSize();
+
+    bool reclaimStale();
+    void updateCounts();
+
+    /** Writes the configuration recorded by applyProposed() back. */
+    void revert();
+
     int m_index;
+    RandRCapabilities m_capabilities;
     QSize m_minSize;
     QSize m_maxSize;
     QRect m_rect;
+    SettingsWriter *m_settingsWriter;
+    qreal m_dpi;
+    bool m_dpiPending;
 
     bool m_outputsUnified;
     QRect m_unifiedRect;
@@ -126,13 +196,22 @@ private:
     RandROutput* m_originalPrimaryOutput;
     RandROutput* m_proposedPrimaryOutput;
 #endif //HAS_RANDR_1_3
+    // cached result of XRRGetOutputPrimary, dropped on screen change events
+    RandROutput* m_primaryOutput;
+    bool m_primaryOutputValid;
 
     XRRScreenResources* m_resources;
+    Time m_timestamp;
+    Time m_configTimestamp;
+    uint m_generation;
 
     CrtcMap m_crtcs;
     OutputMap m_outputs;
     ModeMap m_modes;
 
+    LayoutErrorList m_layoutErrors;
+    RandRJournal m_journal;
+
 };
 
 #endif // RANDRSCREEN_H
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "randrtransform.h"
+
+RandRTransform::RandRTransform()
+    : m_filter(Bilinear)
+{
+    memset(m_matrix, 0, sizeof(m_matrix));
+    m_matrix[0][0] = m_matrix[1][1] = m_matrix[2][2] = 1.0;
+    updateFixed();
+}
+
+RandRTransform::RandRTransform(const double matrix[3][3])
+    : m_filter(Bilinear)
+{
+    memcpy(m_matrix, matrix, sizeof(m_matrix));
+    updateFixed();
+}
+
+void RandRTransform::updateFixed()
+{
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            m_fixed.matrix[i][j] = XDoubleToFixed(m_matrix[i][j]);
+}
+
+RandRTransform RandRTransform::scale(qreal sx, qreal sy)
+{
+    double m[3][3] = { { sx, 0, 0 }, { 0, sy, 0 }, { 0, 0, 1 } };
+    return RandRTransform(m);
+}
+
+RandRTransform RandRTransform::scale(const QSizeF &factors)
+{
+    return scale(factors.width(), factors.height());
+}
+
+RandRTransform RandRTransform::translation(qreal dx, qreal dy)
+{
+    double m[3][3] = { { 1, 0, dx }, { 0, 1, dy }, { 0, 0, 1 } };
+    return RandRTransform(m);
+}
+
+RandRTransform RandRTransform::rotation(qreal degrees)
+{
+    double a = degrees * M_PI / 180.0;
+    double m[3][3] = { { cos(a), -sin(a), 0 }, { sin(a), cos(a), 0 }, { 0, 0, 1 } };
+    return RandRTransform(m);
+}
+
+RandRTransform RandRTransform::keystone(qreal horizontal, qreal vertical)
+{
+    double m[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { horizontal, vertical, 1 } };
+    return RandRTransform(m);
+}
+
+RandRTransform RandRTransform::fromX(const XTransform &transform, const char *filter,
+                                     const XFixed *params, int nparams)
+{
+    double m[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            m[i][j] = XFixedToDouble(transform.matrix[i][j]);
+
+    RandRTransform t(m);
+    QByteArray name(filter ? filter : "");
+    if (name.isEmpty() || name == "bilinear")
+        t.m_filter = Bilinear;
+    else if (name == "nearest")
+        t.m_filter = Nearest;
+    else
+    {
+        t.m_filter = Custom;
+        t.m_customFilter = name;
+    }
+    for (int i = 0; i < nparams; ++i)
+        t.m_params.append(params[i]);
+    return t;
+}
+
+RandRTransform RandRTransform::operator*(const RandRTransform &other) const
+{
+    double m[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            m[i][j] = 0;
+            for (int k = 0; k < 3; ++k)
+                m[i][j] += m_matrix[i][k] * other.m_matrix[k][j];
+        }
+
+    RandRTransform t(m);
+    t.m_filter = m_filter;
+    t.m_customFilter = m_customFilter;
+    t.m_params = m_params;
+    return t;
+}
+
+bool RandRTransform::operator==(const RandRTransform &other) const
+{
+    return memcmp(&m_fixed, &other.m_fixed, sizeof(m_fixed)) == 0
+        && filterName() == other.filterName()
+        && m_params == other.m_params;
+}
+
+bool RandRTransform::operator!=(const RandRTransform &other) const
+{
+    return !(*this == other);
+}
+
+bool RandRTransform::isIdentity() const
+{
+    static const RandRTransform identity;
+    return memcmp(&m_fixed, &identity.m_fixed, sizeof(m_fixed)) == 0;
+}
+
+bool RandRTransform::isScale() const
+{
+    return m_fixed.matrix[0][1] == 0 && m_fixed.matrix[0][2] == 0
+        && m_fixed.matrix[1][0] == 0 && m_fixed.matrix[1][2] == 0
+        && m_fixed.matrix[2][0] == 0 && m_fixed.matrix[2][1] == 0
+        && m_fixed.matrix[2][2] != 0;
+}
+
+QSizeF RandRTransform::scaleFactors() const
+{
+    if (m_matrix[2][2] == 0)
+        return QSizeF(1.0, 1.0);
+    return QSizeF(m_matrix[0][0] / m_matrix[2][2], m_matrix[1][1] / m_matrix[2][2]);
+}
+
+QRect RandRTransform::mapRect(const QSize &size) const
+{
+    const double corners[4][2] = {
+        { 0, 0 }, { (double)size.width(), 0 },
+        { 0, (double)size.height() }, { (double)size.width(), (double)size.height() }
+    };
+
+    double left = 0, top = 0, right = 0, bottom = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        double x = corners[i][0], y = corners[i][1];
+        double w = m_matrix[2][0] * x + m_matrix[2][1] * y + m_matrix[2][2];
+        if (w == 0)
+            continue;
+
+        double fx = (m_matrix[0][0] * x + m_matrix[0][1] * y + m_matrix[0][2]) / w;
+        double fy = (m_matrix[1][0] * x + m_matrix[1][1] * y + m_matrix[1][2]) / w;
+        if (i == 0 || fx < left)
+            left = fx;
+        if (i == 0 || fx > right)
+            right = fx;
+        if (i == 0 || fy < top)
+            top = fy;
+        if (i == 0 || fy > bottom)
+            bottom = fy;
+    }
+
+    int x = (int)floor(left + 0.5);
+    int y = (int)floor(top + 0.5);
+    return QRect(x, y, (int)floor(right + 0.5) - x, (int)floor(bottom + 0.5) - y);
+}
+
+QSize RandRTransform::mapSize(const QSize &size) const
+{
+    return mapRect(size).size();
+}
+
+RandRTransform RandRTransform::normalized(const QSize &size) const
+{
+    // only rotations and projective terms move the area on their own
+    if (m_matrix[0][1] == 0 && m_matrix[1][0] == 0
+        && m_matrix[2][0] == 0 && m_matrix[2][1] == 0)
+        return *this;
+
+    QRect r = mapRect(size);
+    if (r.topLeft() == QPoint(0, 0))
+        return *this;
+
+    double m[3][3] = { { 1, 0, (double)-r.x() }, { 0, 1, (double)-r.y() }, { 0, 0, 1 } };
+    RandRTransform translate(m);
+    translate.m_filter = m_filter;
+    translate.m_customFilter = m_customFilter;
+    translate.m_params = m_params;
+    return translate * *this;
+}
+
+RandRTransform::Filter RandRTransform::filter() const
+{
+    return m_filter;
+}
+
+QByteArray RandRTransform::filterName() const
+{
+    switch (m_filter)
+    {
+        case Nearest:
+            return "nearest";
+        case Custom:
+            return m_customFilter;
+        case Bilinear:
+        default:
+            return "bilinear";
+    }
+}
+
+void RandRTransform::setFilter(Filter filter)
+{
+    m_filter = filter;
+    if (filter != Custom)
+    {
+        m_customFilter.clear();
+        m_params.clear();
+    }
+}
+
+void RandRTransform::setCustomFilter(const QByteArray &name, const QVector<double> &params)
+{
+    m_filter = Custom;
+    m_customFilter = name;
+    m_params.clear();
+    foreach(double p, params)
+        m_params.append(XDoubleToFixed(p));
+}
+
+const XTransform &RandRTransform::fixed() const
+{
+    return m_fixed;
+}
+
+XFixed *RandRTransform::params() const
+{
+    return m_params.isEmpty() ? 0 : const_cast<XFixed*>(m_params.constData());
+}
+
+int RandRTransform::paramCount() const
+{
+    return m_params.count();
+}
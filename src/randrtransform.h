@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRTRANSFORM_H
+#define RANDRTRANSFORM_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QRect>
+#include <QtCore/QSizeF>
+#include <QtCore/QVector>
+
+#include "randr.h"
+
+/** A CRTC transform: the projective matrix mapping CRTC pixels to the
+ * framebuffer, and the filter used to sample it.
+ *
+ * Transforms are built from scale, rotation and keystone factors and can be
+ * combined. The matrix is kept in the XFixed form it is sent in, so two
+ * transforms compare equal exactly when uploading one over the other would
+ * not change anything. */
+class RandRTransform
+{
+public:
+    enum Filter {
+        Nearest,
+        Bilinear,
+        Custom
+    };
+
+    /** The identity, sampled with the bilinear filter. */
+    RandRTransform();
+
+    static RandRTransform scale(qreal sx, qreal sy);
+    static RandRTransform scale(const QSizeF &factors);
+
+    /** Moves the framebuffer area shown by @p dx, @p dy. */
+    static RandRTransform translation(qreal dx, qreal dy);
+
+    /** Rotation by @p degrees. Use normalized() to keep the rotated area
+     * at the CRTC position. */
+    static RandRTransform rotation(qreal degrees);
+
+    /** Perspective correction for a projector that is not square to the
+     * screen; @p horizontal and @p vertical are the projective terms. */
+    static RandRTransform keystone(qreal horizontal, qreal vertical);
+
+    static RandRTransform fromX(const XTransform &transform, const char *filter,
+                                const XFixed *params, int nparams);
+
+    /** The transform applying @p other first, then this one. */
+    RandRTransform operator*(const RandRTransform &other) const;
+
+    bool operator==(const RandRTransform &other) const;
+    bool operator!=(const RandRTransform &other) const;
+
+    bool isIdentity() const;
+
+    /** True if the matrix only scales along the axes. */
+    bool isScale() const;
+    QSizeF scaleFactors() const;
+
+    /** Area of the framebuffer a CRTC with a mode of @p size covers. */
+    QRect mapRect(const QSize &size) const;
+    QSize mapSize(const QSize &size) const;
+
+    /** This transform moved so that a mode of @p size maps to an area
+     * starting at the CRTC position. A scale along the axes is left as it
+     * is: its offset is deliberate, e.g. to letterbox an area. */
+    RandRTransform normalized(const QSize &size) const;
+
+    Filter filter() const;
+    QByteArray filterName() const;
+    void setFilter(Filter filter);
+    void setCustomFilter(const QByteArray &name, const QVector<double> &params = QVector<double>());
+
+    const XTransform &fixed() const;
+    XFixed *params() const;
+    int paramCount() const;
+
+private:
+    RandRTransform(const double matrix[3][3]);
+    void updateFixed();
+
+    double m_matrix[3][3];
+    XTransform m_fixed;
+    Filter m_filter;
+    QByteArray m_customFilter;
+    QVector<XFixed> m_params;
+};
+
+#endif // RANDRTRANSFORM_H
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
+#include <QtCore/QMetaObject>
+#include <QtGui/QX11Info>
+#include <unistd.h>
+
+#include "randrworker.h"
+#include "randrgammainfo.h"
+
+RandRWorker *RandRWorker::s_instance = 0;
+QThread *RandRWorker::s_thread = 0;
+
+RandRWorker::RandRWorker()
+    : m_dpy(0),
+      m_gammaTimer(0)
+{
+}
+
+RandRWorker::~RandRWorker()
+{
+}
+
+RandRWorker *RandRWorker::instance()
+{
+    if (!s_instance)
+    {
+        s_thread = new QThread;
+        s_instance = new RandRWorker;
+        s_instance->moveToThread(s_thread);
+        connect(s_thread, SIGNAL(started()), s_instance, SLOT(open()));
+        s_thread->start();
+    }
+    return s_instance;
+}
+
+void RandRWorker::shutdown()
+{
+    if (!s_instance)
+        return;
+
+    // blocks until the worker is done with everything queued before
+    QMetaObject::invokeMethod(s_instance, "finish", Qt::BlockingQueuedConnection);
+    s_thread->quit();
+    s_thread->wait();
+
+    delete s_instance;
+    delete s_thread;
+    s_instance = 0;
+    s_thread = 0;
+}
+
+void RandRWorker::cancelBrightness()
+{
+    if (!s_instance)
+        return;
+
+    // blocking, so that nothing pending is set after the caller goes on
+    QMetaObject::invokeMethod(s_instance, "dropBrightness", Qt::BlockingQueuedConnection);
+}
+
+void RandRWorker::setBrightness(RRCrtc crtc, float brightness, float red, float green,
+                                float blue, int delay)
+{
+    QMetaObject::invokeMethod(this, "queueBrightness", Qt::QueuedConnection,
+                              Q_ARG(ulong, crtc), Q_ARG(float, brightness),
+                              Q_ARG(float, red), Q_ARG(float, green), Q_ARG(float, blue),
+                              Q_ARG(int, delay));
+}
+
+void RandRWorker::previewBrightness(RRCrtc crtc, float brightness, float red, float green,
+                                    float blue, int interval)
+{
+    QMetaObject::invokeMethod(this, "queuePreview", Qt::QueuedConnection,
+                              Q_ARG(ulong, crtc), Q_ARG(float, brightness),
+                              Q_ARG(float, red), Q_ARG(float, green), Q_ARG(float, blue),
+                              Q_ARG(int, interval));
+}
+
+void RandRWorker::probe(int screen)
+{
+    QMetaObject::invokeMethod(this, "runProbe", Qt::QueuedConnection, Q_ARG(int, screen));
+}
+
+void RandRWorker::open()
+{
+    // the GUI connection must not be used from this thread
+    m_dpy = XOpenDisplay(DisplayString(QX11Info::display()));
+    if (!m_dpy)
+        qDebug() << "RandRWorker: could not open a connection to the X server";
+
+    m_gammaTimer = new QTimer(this);
+    m_gammaTimer->setSingleShot(true);
+    connect(m_gammaTimer, SIGNAL(timeout()), this, SLOT(applyBrightness()));
+}
+
+void RandRWorker::finish()
+{
+    if (m_gammaTimer && m_gammaTimer->isActive())
+    {
+        // keep the delay the brightness was queued with
+        int wait = QTime::currentTime().msecsTo(m_gammaDue);
+        if (wait > 0)
+            usleep(wait * 1000);
+        m_gammaTimer->stop();
+        applyBrightness();
+    }
+
+    if (m_dpy)
+        XCloseDisplay(m_dpy);
+    m_dpy = 0;
+}
+
+void RandRWorker::dropBrightness()
+{
+    if (m_gammaTimer)
+        m_gammaTimer->stop();
+    m_gamma.clear();
+}
+
+void RandRWorker::queueBrightness(ulong crtc, float brightness, float red, float green,
+                                  float blue, int delay)
+{
+    Gamma gamma;
+    gamma.brightness = brightness;
+    gamma.red = red;
+    gamma.green = green;
+    gamma.blue = blue;
+    // Gamma is applied twice after a new configuration
+    gamma.uploads = 2;
+    m_gamma.insert(crtc, gamma);
+
+    // the last request decides when everything pending is set
+    m_gammaDue = QTime::currentTime().addMSecs(delay);
+    m_gammaTimer->start(delay);
+}
+
+void RandRWorker::queuePreview(ulong crtc, float brightness, float red, float green,
+                               float blue, int interval)
+{
+    Gamma gamma;
+    gamma.brightness = brightness;
+    gamma.red = red;
+    gamma.green = green;
+    gamma.blue = blue;
+    gamma.uploads = m_gamma.contains(crtc) ? m_gamma.value(crtc).uploads : 1;
+    m_gamma.insert(crtc, gamma);
+
+    // a pending upload picks up the new value; otherwise wait out the rest
+    // of the interval since the last one
+    if (m_gammaTimer->isActive())
+        return;
+
+    int wait = 0;
+    if (m_gammaApplied.isValid())
+        wait = qMax(0, interval - m_gammaApplied.elapsed());
+    m_gammaDue = QTime::currentTime().addMSecs(wait);
+    m_gammaTimer->start(wait);
+}
+
+void RandRWorker::applyBrightness()
+{
+    if (!m_dpy)
+    {
+        m_gamma.clear();
+        return;
+    }
+
+    QHash<ulong, Gamma>::const_iterator it;
+    for (it = m_gamma.constBegin(); it != m_gamma.constEnd(); ++it)
+    {
+        const Gamma &gamma = it.value();
+        for (int i = 0; i < gamma.uploads; ++i)
+            set_gamma(m_dpy, 0, it.key(), gamma.brightness, gamma.red, gamma.blue, gamma.green);
+    }
+    XFlush(m_dpy);
+    m_gamma.clear();
+    m_gammaApplied.start();
+}
+
+void RandRWorker::runProbe(int screen)
+{
+    if (!m_dpy)
+        return;
+
+    // polling the outputs updates the server state; the GUI connection
+    // learns about changes through the usual RandR events
+    XRRScreenResources *resources = XRRGetScreenResources(m_dpy, RootWindow(m_dpy, screen));
+    if (!resources)
+        return;
+
+    Time timestamp = resources->timestamp;
+    Time configTimestamp = resources->configTimestamp;
+    XRRFreeScreenResources(resources);
+    emit probed(screen, timestamp, configTimestamp);
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef RANDRWORKER_H
+#define RANDRWORKER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QHash>
+#include <QtCore/QTime>
+
+#include "randr.h"
+
+class QThread;
+class QTimer;
+
+/** Runs slow X requests on a thread of its own.
+ *
+ * The worker opens its own connection to the X server, so its requests
+ * never wait behind or block the ones of the GUI thread. Work is queued
+ * through the public methods, which may be called from any thread; the
+ * results come back through queued signals.
+ *
+ * Brightness is set with a delay so that the server settles a new
+ * configuration first; later requests for the same CRTC replace pending
+ * ones. Previews only upload the gamma ramps, at most once per interval,
+ * so dragging a slider follows the refresh of the output instead of
+ * flooding the server. A probe asks the server to poll the outputs for
+ * changes, which takes a while on many drivers.
+ *
+ * Applying a layout does not go through the worker: validating it,
+ * handing out the CRTCs, setting them and rolling them back read and
+ * update the RandRScreen, RandRCrtc and RandROutput objects of the GUI
+ * thread step by step, and the confirmation needs the GUI anyway. Those
+ * requests are short round trips on the GUI connection; only the waits
+ * and the probing, which took seconds, run here. */
+class RandRWorker : public QObject
+{
+    Q_OBJECT
+public:
+    /** The worker, started on first use. */
+    static RandRWorker *instance();
+
+    /** Finishes the queued work and stops the thread. Does nothing if the
+     * worker was never started. */
+    static void shutdown();
+
+    /** Drops the brightness changes that were not set yet, e.g. because
+     * the configuration they belong to is rolled back. Does nothing if the
+     * worker was never started. */
+    static void cancelBrightness();
+
+    void setBrightness(RRCrtc crtc, float brightness, float red, float green, float blue,
+                       int delay = 0);
+    void previewBrightness(RRCrtc crtc, float brightness, float red, float green, float blue,
+                           int interval);
+    void probe(int screen);
+
+signals:
+    /** The outputs of @p screen were polled; the timestamps are the ones
+     * the server has after that. */
+    void probed(int screen, ulong timestamp, ulong configTimestamp);
+
+private slots:
+    void open();
+    void finish();
+    void dropBrightness();
+    void queueBrightness(ulong crtc, float brightness, float red, float green, float blue,
+                         int delay);
+    void queuePreview(ulong crtc, float brightness, float red, float green, float blue,
+                      int interval);
+    void applyBrightness();
+    void runProbe(int screen);
+
+private:
+    RandRWorker();
+    ~RandRWorker();
+
+    struct Gamma
+    {
+        float brightness;
+        float red;
+        float green;
+        float blue;
+        int uploads;
+    };
+
+    static RandRWorker *s_instance;
+    static QThread *s_thread;
+
+    Display *m_dpy;
+    QTimer *m_gammaTimer;
+    QTime m_gammaDue;
+    QTime m_gammaApplied;
+    QHash<ulong, Gamma> m_gamma;
+};
+
+#endif // RANDRWORKER_H
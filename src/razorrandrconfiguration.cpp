@@ -22,14 +22,18 @@
 
 #include "razorrandrconfiguration.h"
 #include "ui_razorrandrconfiguration.h"
+#include "randrbenchmark.h"
 
 LXQtRandrConfig::LXQtRandrConfig(QWidget *parent) :
     QDialog(parent),
     mUi(new Ui::RazorRandrConfiguration)
 {
+    RandRBenchmark::Phase phase("LXQtRandrConfig");
     mUi->setupUi(this);
     setWindowIcon(QIcon(":/icons/preferences-desktop-display.png"));
     updateButtons(false);
+    // keep the dialog from waiting for the outputs to be polled
+    RandR::probe_async = true;
     mRandrDisplay = new RandRDisplay();
     mRandrConfig = new RandRConfig(this, mRandrDisplay);
 
@@ -39,8 +43,9 @@ LXQtRandrConfig::LXQtRandrConfig(QWidget *parent) :
 
 LXQtRandrConfig::~LXQtRandrConfig()
 {
-    delete mRandrDisplay;
+    // the config puts previewed brightness back through the display
     delete mRandrConfig;
+    delete mRandrDisplay;
     delete mUi;
 }
 
@@ -65,6 +70,7 @@ void LXQtRandrConfig::on_buttonBox_clicked(QAbstractButton *button)
     }
     else if(mUi->buttonBox->button(QDialogButtonBox::Cancel) == button)
     {
+        mRandrConfig->cancelPreviews();
         QApplication::quit();
     }
     else if(mUi->buttonBox->button(QDialogButtonBox::Reset) == button)
@@ -78,6 +84,13 @@ void LXQtRandrConfig::on_buttonBox_clicked(QAbstractButton *button)
     }
 }
 
+void LXQtRandrConfig::reject()
+{
+    // closing the window or pressing Escape discards the changes too
+    mRandrConfig->cancelPreviews();
+    QDialog::reject();
+}
+
 void LXQtRandrConfig::about()
 {
     QMessageBox::about(this, QString("LXQt Randr ") + STR_VERSION,
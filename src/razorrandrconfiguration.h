@@ -38,6 +38,9 @@ public:
     ~LXQtRandrConfig();
     void about();
 
+public slots:
+    virtual void reject();
+
 private slots:
     void on_buttonBox_clicked(QAbstractButton *button);
     void updateButtons(bool status);
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QCoreApplication>
+#include <QtCore/QDebug>
+
+#include "settingswriter.h"
+#include "randrscreen.h"
+#include "randrconfigstore.h"
+
+SettingsWriter::SettingsWriter(RandRScreen *screen)
+    : QObject(screen),
+      m_screen(screen),
+      m_dirty(false)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setInterval(500);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(flush()));
+
+    if (QCoreApplication::instance())
+        connect(QCoreApplication::instance(), SIGNAL(aboutToQuit()), this, SLOT(flush()));
+}
+
+SettingsWriter::~SettingsWriter()
+{
+    flush();
+}
+
+void SettingsWriter::setDelay(int msec)
+{
+    m_timer.setInterval(msec);
+}
+
+bool SettingsWriter::isDirty() const
+{
+    return m_dirty;
+}
+
+void SettingsWriter::markDirty()
+{
+    m_dirty = true;
+    // restart the timer, the write happens once changes settle
+    m_timer.start();
+}
+
+bool SettingsWriter::flush()
+{
+    m_timer.stop();
+    if (!m_dirty)
+        return true;
+
+    if (!write())
+    {
+        qDebug() << "Failed to write the settings, keeping them pending";
+        return false;
+    }
+
+    m_dirty = false;
+    return true;
+}
+
+bool SettingsWriter::write()
+{
+    // the store holds the other screens too, so start from what is there
+    // and let the screen write its part on top of it
+    RandRConfigStore store;
+    store.open();
+    m_screen->save(store);
+    if (!store.write())
+        return false;
+
+    qDebug() << "Settings written to" << RandRConfigStore::defaultFileName();
+    return true;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef SETTINGSWRITER_H
+#define SETTINGSWRITER_H
+
+#include <QtCore/QObject>
+#include <QtCore/QTimer>
+
+#include "randr.h"
+
+/** Writes the settings of a screen behind the changes.
+ *
+ * Changes only mark the settings dirty; they are written once when no
+ * further change came in for a while, so an event storm or a layout apply
+ * touching every CRTC ends up as a single write to the RandRConfigStore,
+ * which replaces its file in one step, so a crash never leaves a truncated
+ * file behind. Pending changes are flushed when the
+ * application quits and when the writer is destroyed. */
+class SettingsWriter : public QObject
+{
+    Q_OBJECT
+public:
+    SettingsWriter(RandRScreen *screen);
+    ~SettingsWriter();
+
+    /** Time in milliseconds to wait for changes to settle. */
+    void setDelay(int msec);
+
+    bool isDirty() const;
+
+public slots:
+    void markDirty();
+
+    /** Writes pending changes now. Returns false if the write failed; the
+     * changes stay pending then. */
+    bool flush();
+
+private:
+    bool write();
+
+    RandRScreen *m_screen;
+    QTimer m_timer;
+    bool m_dirty;
+};
+
+#endif // SETTINGSWRITER_H
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <QtCore/QDebug>
+#include <math.h>
+
+#include "videowalllayout.h"
+#include "randrscreen.h"
+#include "randroutput.h"
+
+VideoWallLayout::VideoWallLayout(RandRScreen *screen)
+    : m_screen(screen),
+      m_rows(1),
+      m_columns(1),
+      m_bezelH(0),
+      m_bezelV(0)
+{
+}
+
+void VideoWallLayout::setGrid(int rows, int columns)
+{
+    m_rows = rows;
+    m_columns = columns;
+}
+
+void VideoWallLayout::setBezel(qreal horizontal, qreal vertical)
+{
+    m_bezelH = horizontal;
+    m_bezelV = vertical;
+}
+
+void VideoWallLayout::setOrder(const QList<RandROutput*> &outputs)
+{
+    m_order = outputs;
+}
+
+bool VideoWallLayout::fail(const QString &error)
+{
+    qDebug() << "Video wall:" << error;
+    m_error = error;
+    m_rects.clear();
+    m_size = QSize();
+    return false;
+}
+
+bool VideoWallLayout::compute()
+{
+    m_error.clear();
+    m_rects.clear();
+
+    if (m_rows < 1 || m_columns < 1)
+        return fail(QString("invalid grid %1x%2").arg(m_rows).arg(m_columns));
+
+    QList<RandROutput*> panels = m_order;
+    if (panels.isEmpty())
+    {
+        QMap<QString, RandROutput*> byName;
+        foreach(RandROutput *output, m_screen->outputs())
+        {
+            if (output->isConnected())
+                byName.insert(output->name(), output);
+        }
+        panels = byName.values();
+    }
+
+    if (panels.count() != m_rows * m_columns)
+        return fail(QString("a %1x%2 wall needs %3 panels, got %4")
+                    .arg(m_rows).arg(m_columns).arg(m_rows * m_columns).arg(panels.count()));
+
+    // every panel must be driven at the same mode size and have the same
+    // physical size, otherwise the grid doesn't line up
+    m_mode = RandRMode();
+    QSize mm;
+    foreach(RandROutput *output, panels)
+    {
+        if (panels.count(output) > 1)
+            return fail(QString("%1 is given more than once").arg(output->name()));
+        if (!output->isConnected())
+            return fail(QString("%1 is not connected").arg(output->name()));
+
+        RandRMode mode = output->preferredMode();
+        if (!mode.isValid())
+            mode = output->mode();
+        if (!mode.isValid())
+            return fail(QString("no mode for %1").arg(output->name()));
+
+        if (!m_mode.isValid())
+        {
+            m_mode = mode;
+            mm = output->physicalSize();
+        }
+        else if (mode.size() != m_mode.size())
+            return fail(QString("%1 runs at %2x%3, the wall at %4x%5").arg(output->name())
+                        .arg(mode.size().width()).arg(mode.size().height())
+                        .arg(m_mode.size().width()).arg(m_mode.size().height()));
+        else if (output->physicalSize() != mm)
+            mm = QSize();
+    }
+
+    QSize panel = m_mode.size();
+    int gapX = 0, gapY = 0;
+    if (m_bezelH > 0 || m_bezelV > 0)
+    {
+        if (mm.isEmpty())
+            return fail("bezel compensation needs panels with the same known physical size");
+
+        // a gap hides the bezels of both neighbours
+        gapX = qRound(2 * m_bezelH * panel.width() / mm.width());
+        gapY = qRound(2 * m_bezelV * panel.height() / mm.height());
+    }
+
+    for (int i = 0; i < panels.count(); ++i)
+    {
+        int row = i / m_columns;
+        int column = i % m_columns;
+        QPoint pos(column * (panel.width() + gapX), row * (panel.height() + gapY));
+        m_rects.insert(panels.at(i)->id(), QRect(pos, panel));
+    }
+
+    m_size = QSize(m_columns * panel.width() + (m_columns - 1) * gapX,
+                   m_rows * panel.height() + (m_rows - 1) * gapY);
+
+    if (m_size.width() > m_screen->maxSize().width() || m_size.height() > m_screen->maxSize().height())
+        return fail(QString("the wall needs %1x%2 pixels, the screen allows %3x%4")
+                    .arg(m_size.width()).arg(m_size.height())
+                    .arg(m_screen->maxSize().width()).arg(m_screen->maxSize().height()));
+
+    qDebug() << "Video wall:" << m_rows << "x" << m_columns << "panels of" << panel
+             << "with gaps of" << gapX << "x" << gapY << "pixels, total" << m_size;
+    return true;
+}
+
+void VideoWallLayout::propose()
+{
+    QMap<RROutput, QRect>::const_iterator it;
+    for (it = m_rects.constBegin(); it != m_rects.constEnd(); ++it)
+    {
+        RandROutput *output = m_screen->output(it.key());
+        output->proposeRect(it.value());
+        output->proposeRotation(RandR::Rotate0);
+        output->proposeRefreshRate(m_mode.refreshRate());
+        output->proposeVirtualModeEnabled(false);
+    }
+
+    // outputs left out of the wall would overlap it where they are
+    foreach(RandROutput *output, m_screen->outputs())
+    {
+        if (!m_rects.contains(output->id()) && output->isActive())
+            output->proposeDisable();
+    }
+}
+
+QMap<RROutput, QRect> VideoWallLayout::rects() const
+{
+    return m_rects;
+}
+
+QSize VideoWallLayout::size() const
+{
+    return m_size;
+}
+
+QString VideoWallLayout::errorString() const
+{
+    return m_error;
+}
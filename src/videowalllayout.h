@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2012 Francisco Salvador Ballina Sánchez <zballinita@gmail.com>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef VIDEOWALLLAYOUT_H
+#define VIDEOWALLLAYOUT_H
+
+#include <QtCore/QList>
+#include <QtCore/QMap>
+#include <QtCore/QRect>
+#include <QtCore/QString>
+
+#include "randr.h"
+#include "randrmode.h"
+
+/** Lays out a grid of identical panels as a video wall.
+ *
+ * Panels are placed row by row in the given order, all at the same mode.
+ * With bezel compensation the gap between two neighbouring panels is as
+ * wide, in pixels, as their two bezels are in millimetres, so that an image
+ * crossing the gap continues where it would on a seamless screen. The
+ * pixel pitch comes from the physical size reported in the EDID.
+ *
+ * propose() only proposes the rects; the whole wall is then applied by
+ * RandRScreen::applyProposed() as one layout. */
+class VideoWallLayout
+{
+public:
+    VideoWallLayout(RandRScreen *screen);
+
+    void setGrid(int rows, int columns);
+
+    /** Width in millimetres of the bezel on one side of a panel, for the
+     * left/right and the top/bottom edges. */
+    void setBezel(qreal horizontal, qreal vertical);
+
+    /** Panels in row-major order. If not set, all connected outputs are
+     * used in the order of their names. */
+    void setOrder(const QList<RandROutput*> &outputs);
+
+    /** Computes the rects of all panels. Returns false if the outputs
+     * can't form the requested wall, see errorString(). */
+    bool compute();
+
+    /** Proposes the computed rects to the outputs, and disabling the
+     * active outputs that are not part of the wall. */
+    void propose();
+
+    QMap<RROutput, QRect> rects() const;
+    QSize size() const;
+    QString errorString() const;
+
+private:
+    bool fail(const QString &error);
+
+    RandRScreen *m_screen;
+    int m_rows;
+    int m_columns;
+    qreal m_bezelH;
+    qreal m_bezelV;
+    QList<RandROutput*> m_order;
+
+    RandRMode m_mode;
+    QMap<RROutput, QRect> m_rects;
+    QSize m_size;
+    QString m_error;
+};
+
+#endif // VIDEOWALLLAYOUT_H